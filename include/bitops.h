@@ -37,4 +37,83 @@
 #define NBITS(n) (n==0?0:NBITS32(n))
 
 #define EXTRACT_NBITS(nr, h, l) ((nr&GENMASK(h,l)) >> l)
-#endif
\ No newline at end of file
+
+/*
+ * Bitmaps of BITS_PER_LONG-bit words, e.g. one bit per non-empty queue.
+ * Callers provide their own locking.
+ */
+#define DECLARE_BITMAP(name, bits) \
+	unsigned long name[DIV_ROUND_UP(bits, BITS_PER_LONG)]
+
+static inline void set_bit(unsigned long nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] |= BIT_MASK(nr);
+}
+
+static inline void clear_bit(unsigned long nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] &= ~BIT_MASK(nr);
+}
+
+static inline int test_bit(unsigned long nr, const unsigned long *addr)
+{
+	return (addr[BIT_WORD(nr)] & BIT_MASK(nr)) != 0;
+}
+
+/* Valid bits of one bitmap word, BITS_PER_LONG may be narrower than long */
+#define BITMAP_WORD_MASK (~0UL >> (8 * sizeof(unsigned long) - BITS_PER_LONG))
+
+/* Index of the lowest set bit, or @size if none is set */
+static inline unsigned long find_first_bit(const unsigned long *addr,
+					   unsigned long size)
+{
+	unsigned long i;
+
+	for (i = 0; i * BITS_PER_LONG < size; i++)
+		if (addr[i])
+			return i * BITS_PER_LONG + __builtin_ctzl(addr[i]);
+	return size;
+}
+
+/* Index of the first set bit at or after @offset, or @size if none */
+static inline unsigned long find_next_bit(const unsigned long *addr,
+					  unsigned long size,
+					  unsigned long offset)
+{
+	unsigned long i = BIT_WORD(offset);
+	unsigned long word;
+
+	if (offset >= size)
+		return size;
+	word = addr[i] & BITMAP_WORD_MASK &
+	       (BITMAP_WORD_MASK << (offset % BITS_PER_LONG));
+	while (!word) {
+		if (++i * BITS_PER_LONG >= size)
+			return size;
+		word = addr[i];
+	}
+	offset = i * BITS_PER_LONG + __builtin_ctzl(word);
+	return offset < size ? offset : size;
+}
+
+/* Index of the first clear bit at or after @offset, or @size if none */
+static inline unsigned long find_next_zero_bit(const unsigned long *addr,
+					       unsigned long size,
+					       unsigned long offset)
+{
+	unsigned long i = BIT_WORD(offset);
+	unsigned long word;
+
+	if (offset >= size)
+		return size;
+	word = ~addr[i] & BITMAP_WORD_MASK &
+	       (BITMAP_WORD_MASK << (offset % BITS_PER_LONG));
+	while (!word) {
+		if (++i * BITS_PER_LONG >= size)
+			return size;
+		word = ~addr[i] & BITMAP_WORD_MASK;
+	}
+	offset = i * BITS_PER_LONG + __builtin_ctzl(word);
+	return offset < size ? offset : size;
+}
+#endif
@@ -5,33 +5,47 @@
 #include <pthread.h>
 #include "rbtree.h"
 #include "common.h"
-#include "timer.h"    
+#include "timer.h"
 
-#ifndef CFS_SCHED
-#define CFS_SCHED
-#endif
 #define SCHED_LATENCY_NSEC   200000ULL
 #define MIN_GRANULARITY_NSEC 10000ULL
 #define WEIGHT_NORM          1024ULL
 
+/* Load balancing: a CPU pulls work from the busiest runqueue every
+ * CFS_BALANCE_INTERVAL time slots and whenever its own queue runs dry,
+ * moving at most CFS_MIGRATE_MAX tasks per pass */
+#define CFS_BALANCE_INTERVAL 4
+#define CFS_MIGRATE_MAX      8
+
+/* One runqueue per simulated CPU, each guarded by its own rq_lock.
+ * Tasks are linked through pcb_t::cfs_ent.run_node, ordered by vruntime */
 struct cfs_rq {
-    RBTree          *tree;
+    struct rb_root_cached tasks_timeline;
     uint64_t         total_weight;
+    uint64_t         min_vruntime;
+    uint32_t         nr_running;
+    uint64_t         last_balance;
     pthread_mutex_t  rq_lock;
 };
 
-extern struct cfs_rq cfs_rq;
+extern struct cfs_rq *cfs_rqs;
+extern int            cfs_nr_rqs;
 
 
-void     cfs_init_rq(void);
+void     cfs_init_rq(int nr_cpus);
 uint32_t cfs_compute_weight(int nice);
-void     cfs_enqueue(struct pcb_t *p);
-void     cfs_dequeue(struct pcb_t *p);
-struct pcb_t *cfs_pick_next(void);
-uint64_t cfs_timeslice(struct pcb_t *p,uint32_t extern_weight);
+void     cfs_enqueue(struct cfs_rq *rq, struct pcb_t *p);
+void     cfs_dequeue(struct cfs_rq *rq, struct pcb_t *p);
+void     cfs_add_task(struct pcb_t *p);
+void     cfs_requeue_task(struct pcb_t *p);
+struct pcb_t *cfs_pick_next(int cpu);
+struct pcb_t *cfs_pick_any(void);
+int      cfs_load_balance(int cpu);
+uint32_t cfs_nr_running(void);
+uint64_t cfs_timeslice(int cpu, struct pcb_t *p, uint32_t extern_weight);
 void     cfs_update_vruntime(struct pcb_t *p, uint64_t delta_ns);
-void     cfs_task_tick(struct pcb_t *p, uint64_t elapsed_ns);
+void     cfs_task_tick(int cpu, struct pcb_t *p, uint64_t elapsed_ns);
 
 
 
-#endif /* CFS_H */
\ No newline at end of file
+#endif /* CFS_H */
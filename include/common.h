@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include "rbtree.h"
 
 #ifndef OSCFG_H
 #include "os-cfg.h"
@@ -38,6 +39,10 @@ enum ins_opcode_t
 	READ,  // Write data to a byte on memory
 	WRITE, // Read data from a byte on memory
 	SYSCALL,
+	READB,  // Read a range of bytes
+	WRITEB, // Write a string to a range of bytes
+	COPYB,  // Copy a range of bytes between regions
+	FILLB,  // Set a range of bytes to one value
 };
 
 /* instructions executed by the CPU */
@@ -48,6 +53,8 @@ struct inst_t
 	uint32_t arg_1;
 	uint32_t arg_2;
 	uint32_t arg_3;
+	uint32_t arg_4;
+	char *data; // Bytes written by WRITEB, NULL otherwise
 };
 
 struct code_seg_t
@@ -100,6 +107,7 @@ struct pcb_t
     struct {
         uint64_t vruntime;
         uint32_t weight;
+        struct rb_node run_node; // Linkage in the CFS runqueue tree
     } cfs_ent;
 // #endif
 #ifdef MM_PAGING
@@ -108,6 +116,7 @@ struct pcb_t
 	struct memphy_struct **mswp;
 	struct memphy_struct *active_mswp;
 	uint32_t active_mswp_id;
+	struct tlb_struct *tlb; // TLB of the CPU running the process
 #endif
 	struct page_table_t *page_table; // Page table
 	uint32_t bp;			 // Break pointer
@@ -16,14 +16,23 @@
 #define SYSMEM_SWP_OP 3
 #define SYSMEM_IO_READ 4
 #define SYSMEM_IO_WRITE 5
+/* Ranged I/O within one frame: a2 address, a4 length */
+#define SYSMEM_IO_READ_RANGE 6  /* into regs->buf */
+#define SYSMEM_IO_WRITE_RANGE 7 /* from regs->buf */
+#define SYSMEM_IO_FILL 8        /* a3 value */
+#define SYSMEM_IO_COPY 9        /* a3 destination address */
 
 extern struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 int inc_vma_limit(struct pcb_t*, int, int);
-int __mm_swap_page(struct pcb_t*, int, int);
+int __mm_swap_page(struct pcb_t*, int, int*);
 int liballoc(struct pcb_t *, uint32_t, uint32_t);
 int libfree(struct pcb_t *, uint32_t);
 int libread(struct pcb_t*, uint32_t, uint32_t, uint32_t*);
 int libwrite(struct pcb_t*, BYTE, uint32_t, uint32_t);
+int libread_range(struct pcb_t*, uint32_t, uint32_t, BYTE*, uint32_t);
+int libwrite_range(struct pcb_t*, const BYTE*, uint32_t, uint32_t, uint32_t);
+int libcopy(struct pcb_t*, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
+int libfill(struct pcb_t*, BYTE, uint32_t, uint32_t, uint32_t);
 int free_pcb_memph(struct pcb_t *proc);
 int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller);
 #endif /* __LIBMEM_H__ */
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "common.h"
 
 struct pcb_t * load(const char * path);
+void unload(struct pcb_t * proc);
 
 #endif
 
@@ -2,6 +2,7 @@
 #define MM_H
 #include "bitops.h"
 #include "common.h"
+#include "slab.h"
 
 /* CPU Bus definition */
 #define PAGING_CPU_BUS_WIDTH 22 /* 22bit bus - MAX SPACE 4MB */
@@ -18,13 +19,18 @@
 #define PAGING_PTE_PRESENT_MASK BIT(31) 
 #define PAGING_PTE_SWAPPED_MASK BIT(30)
 #define PAGING_PTE_RESERVE_MASK BIT(29)
-#define PAGING_PTE_DIRTY_MASK BIT(28)
-#define PAGING_PTE_EMPTY01_MASK BIT(14)
+#define PAGING_PTE_DIRTY_MASK BIT(28) /* written since it was last swapped in */
+#define PAGING_PTE_ACCESSED_MASK BIT(14) /* referenced since the last CLOCK sweep */
 #define PAGING_PTE_EMPTY02_MASK BIT(13)
 
+_Static_assert((PAGING_PGD_ENTRIES << PAGING_PTE_SHIFT) == PAGING_MAX_PGN,
+               "page table levels must cover PAGING_MAX_PGN pages");
+#define PAGING_PGD_IDX(pgn) ((pgn) >> PAGING_PTE_SHIFT)
+#define PAGING_PTE_IDX(pgn) ((pgn) & ((1 << PAGING_PTE_SHIFT) - 1))
+
 /* PTE BIT PRESENT */
-#define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
-#define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
+#define PAGING_PTE_SET_PRESENT(pte) ((pte) = (pte) | PAGING_PTE_PRESENT_MASK)
+#define PAGING_PAGE_PRESENT(pte) ((pte) & PAGING_PTE_PRESENT_MASK)
 
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
@@ -50,6 +56,14 @@
 #define PAGING_PTE_PGN(pte)   GETVAL(pte,PAGING_PGN_MASK,PAGING_ADDR_PGN_LOBIT)
 #define PAGING_PTE_FPN(pte)   GETVAL(pte,PAGING_PTE_FPN_MASK,PAGING_PTE_FPN_LOBIT)
 #define PAGING_PTE_SWP(pte)   GETVAL(pte,PAGING_PTE_SWPOFF_MASK,PAGING_SWPFPN_OFFSET)
+#define PAGING_PTE_SWPTYP(pte) GETVAL(pte,PAGING_PTE_SWPTYP_MASK,PAGING_PTE_SWPTYP_LOBIT)
+
+/* Swap entry: the SWPTYP and SWPOFF fields of a swapped PTE as one int */
+#define SWP_ENTRY(typ, off) (((off) << PAGING_SWPFPN_OFFSET) | (typ))
+#define SWP_TYPE(ent)   ((ent) & PAGING_PTE_SWPTYP_MASK)
+#define SWP_OFFSET(ent) ((ent) >> PAGING_SWPFPN_OFFSET)
+#define PAGING_PTE_SWPENT(pte) ((pte) & (PAGING_PTE_SWPTYP_MASK | PAGING_PTE_SWPOFF_MASK))
+#define SWP_TYPE_ZSWAP  0x1f /* compressed pool, see mm-zswap.c */
 
 /* OFFSET */
 #define PAGING_ADDR_OFFST_LOBIT 0
@@ -66,14 +80,14 @@
 /* SWAPFPN */
 #define PAGING_SWP_LOBIT NBITS(PAGING_PAGESZ)
 #define PAGING_SWP_HIBIT (NBITS(PAGING_MEMSWPSZ) - 1)
-#define PAGING_SWP(pte) ((pte&PAGING_PTE_SWPOFF_MASK) >> PAGING_SWPFPN_OFFSET)
+#define PAGING_SWP(pte) (((pte) & PAGING_PTE_SWPOFF_MASK) >> PAGING_SWPFPN_OFFSET)
 
 /* Value operators */
-#define SETBIT(v,mask) (v=v|mask)
-#define CLRBIT(v,mask) (v=v&~mask)
+#define SETBIT(v,mask) ((v) = (v) | (mask))
+#define CLRBIT(v,mask) ((v) = (v) & ~(mask))
 
-#define SETVAL(v,value,mask,offst) (v=(v&~mask)|((value<<offst)&mask))
-#define GETVAL(v,mask,offst) ((v&mask)>>offst)
+#define SETVAL(v,value,mask,offst) ((v) = ((v) & ~(mask)) | (((value) << (offst)) & (mask)))
+#define GETVAL(v,mask,offst) (((v) & (mask)) >> (offst))
 
 /* Masks */
 #define PAGING_OFFST_MASK  GENMASK(PAGING_ADDR_OFFST_HIBIT,PAGING_ADDR_OFFST_LOBIT)
@@ -98,6 +112,11 @@
 #define INCLUDE(x1,x2,y1,y2) (0)
 #define OVERLAP(x1,x2,y1,y2) (0)
 
+/* Object caches of the MM metadata nodes (mm.c) */
+extern struct kmem_cache vm_rg_cache;
+extern struct kmem_cache framephy_cache;
+extern struct kmem_cache pgn_cache;
+
 /* VM region prototypes */
 struct vm_rg_struct * init_vm_rg(int rg_start, int rg_endi);
 int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct* rgnode);
@@ -109,6 +128,21 @@ int alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                 struct memphy_struct *mpdst, int dstfpn) ;
 int pte_set_fpn(uint32_t *pte, int fpn);
+
+/* PTE of page @pgn, or NULL if it was never used: no leaf table, no PTE */
+static inline uint32_t *pte_lookup(struct mm_struct *mm, int pgn)
+{
+  uint32_t *leaf = mm->pgd[PAGING_PGD_IDX(pgn)];
+  return leaf ? &leaf[PAGING_PTE_IDX(pgn)] : NULL;
+}
+uint32_t *pte_alloc(struct mm_struct *mm, int pgn);
+int pte_next_mapped(struct mm_struct *mm, int pgn, uint32_t **ptep);
+void free_pgd(struct mm_struct *mm);
+
+/* Visit every mapped or swapped page of @mm, skipping unused leaf tables */
+#define for_each_mapped_pte(mm, pgn, ptep) \
+  for ((pgn) = pte_next_mapped(mm, 0, &(ptep)); (pgn) >= 0; \
+       (pgn) = pte_next_mapped(mm, (pgn) + 1, &(ptep)))
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff);
 int init_pte(uint32_t *pte,
              int pre,    // present
@@ -122,6 +156,67 @@ int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+void exit_mm(struct pcb_t *caller);
+
+/* Page replacement policies (mm-repl.c): fifo, clock, 2q */
+#define REPL_DEFAULT_POLICY 0 /* fifo */
+#define REPL_2Q_KIN_PCT  25 /* A1in share of the resident pages */
+#define REPL_2Q_KOUT_PCT 50 /* ghost entries kept, relative to resident pages */
+
+struct repl_policy {
+   const char *name;
+   void (*page_mapped)(struct mm_struct *mm, int pgn);
+   int (*find_victim)(struct mm_struct *mm, int *pgn);
+
+   /* Statistics over all processes, updated with __atomic builtins */
+   unsigned long nr_faults;
+   unsigned long nr_evictions;
+   unsigned long nr_writebacks;
+};
+
+int repl_set_policy(const char *name);
+void repl_init_mm(struct mm_struct *mm);
+void repl_free_mm(struct mm_struct *mm);
+void repl_page_mapped(struct mm_struct *mm, int pgn);
+void repl_page_fault(void);
+void repl_page_writeback(int nr);
+void repl_report(void);
+
+/* Software TLB prototypes (mm-tlb.c) */
+void tlb_init(struct tlb_struct *tlb);
+uint32_t *tlb_lookup(struct tlb_struct *tlb, struct pcb_t *caller, int pgn, int *fpn);
+void tlb_insert(struct tlb_struct *tlb, struct pcb_t *caller, int pgn, int fpn);
+void tlb_flush_mm(struct mm_struct *mm);
+void tlb_report(struct tlb_struct *tlb, int nr_cpus);
+
+/* Swap devices (mm-swap.c) */
+void swap_init(struct memphy_struct **mswp, int nr);
+struct memphy_struct *swap_dev(int ent);
+int swap_get_slot(int *ent);
+int swap_get_slots(int nr, int *ent);
+int swap_put_slot(int ent);
+int swap_write_pages(struct memphy_struct *mram, const int *fpn,
+                     int *ent, int nr);
+int swap_read_page(int ent, struct memphy_struct *mram, int fpn);
+void swap_report(void);
+
+/* Compressed swap pool (mm-zswap.c) */
+void zswap_init(struct memphy_struct *mram);
+int zswap_store(struct memphy_struct *mram, int fpn, int *ent);
+int zswap_load(int ent, struct memphy_struct *mram, int fpn);
+int zswap_free(int ent);
+void zswap_report(void);
+
+/* Background reclaim (mm-kswapd.c) */
+struct kswapd_args {
+   struct timer_id_t *timer_id;
+   struct memphy_struct *mram;
+};
+
+void mm_register(struct pcb_t *proc);
+void mm_unregister(struct pcb_t *proc);
+void *kswapd_routine(void *args);
+void kswapd_report(void);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -142,15 +237,32 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz);
 int find_victim_page(struct mm_struct* mm, int *pgn);
+int reclaim_pages(struct pcb_t *caller, int nr);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
+struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nr, int *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
+int MEMPHY_nr_freefp(struct memphy_struct *mp);
 int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
+int MEMPHY_copy_frames(struct memphy_struct *src, int srcfpn,
+                       struct memphy_struct *dst, int dstfpn, int nr);
+int MEMPHY_copy_range(struct memphy_struct *src, int addrsrc,
+                      struct memphy_struct *dst, int addrdst, int len);
+int MEMPHY_read_range(struct memphy_struct *mp, int addr, BYTE *buf, int len);
+int MEMPHY_write_range(struct memphy_struct *mp, int addr, const BYTE *buf, int len);
+int MEMPHY_fill(struct memphy_struct *mp, int addr, BYTE value, int len);
+int MEMPHY_zero_frame(struct memphy_struct *mp, int fpn);
 int MEMPHY_dump(struct memphy_struct * mp);
+void MEMPHY_report(const char *name, struct memphy_struct *mp);
+int MEMPHY_take_latency(void);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, int max_size, int randomflg,
+                     const char *path);
+void free_memphy(struct memphy_struct *mp);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
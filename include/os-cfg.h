@@ -5,8 +5,46 @@
 #define CFS_SCHED 1
 #define MAX_PRIO 140
 
+/* Event engine: simulate all CPUs on at most SIM_NR_WORKERS host threads
+ * instead of one thread per CPU */
+// #define SIM_EVENT_ENGINE
+#define SIM_NR_WORKERS 4
+
 #define MM_PAGING
 #define MM_FIXED_MEMSZ
+/* Map frames when a region is allocated instead of on first touch */
+// #define MM_POPULATE
+/* Background reclaim: kswapd wakes up when free RAM frames drop below the
+ * low watermark and evicts until the high one is reached (percent of RAM) */
+// #define MM_KSWAPD
+#define KSWAPD_WMARK_LOW_PCT 10
+#define KSWAPD_WMARK_HIGH_PCT 20
+#define KSWAPD_BATCH 8
+/* Priority of each swap device: higher ones fill up first, equal ones
+ * are striped round robin */
+#define MM_SWAP_PRIO { 0, 0, 0, 0 }
+/* Compressed swap pool taking ZSWAP_POOL_PCT percent of RAM, pages that
+ * do not shrink below ZSWAP_MAX_PCT percent go to the swap devices */
+// #define MM_ZSWAP
+#define ZSWAP_POOL_PCT 10
+#define ZSWAP_MAX_PCT 75
+/* Device storage is anonymous memory, zero filled on first touch. With
+ * MM_SWAP_FILE, swap device i is instead a file named by formatting the
+ * pattern with i, whose image stays on disk after the run */
+// #define MM_SWAP_FILE "swap%d.img"
+/* Swap devices are sequential access, like tapes. Moving the head by
+ * MEMPHY_SEEK_CELLS_PER_SLOT cells costs one time slot */
+// #define MM_SWAP_SEQ
+#define MEMPHY_SEEK_CELLS_PER_SLOT 4096
+/* Device timing of MEMRAM and of each MEMSWP: latency in time slots per
+ * access and bandwidth in bytes per slot, 0 for free. A process waiting
+ * on a device is blocked while its CPU runs another one */
+#define MEMPHY_RAM_LATENCY 0
+#define MEMPHY_RAM_BANDWIDTH 0
+#define MEMPHY_SWP_LATENCY { 0, 0, 0, 0 }
+#define MEMPHY_SWP_BANDWIDTH { 0, 0, 0, 0 }
+/* Print paging, swap, slab and device statistics at the end of the run */
+// #define MM_STATS
 //#define VMDBG 1
 //#define MMDBG 1
 #define IODUMP 1
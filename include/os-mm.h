@@ -1,10 +1,19 @@
 #ifndef OSMM_H
 #define OSMM_H
 
+#include <pthread.h>
+#include "rbtree.h"
+
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
 #define PAGING_MAX_SYMTBL_SZ 40
+#define TLB_NR_ENTRIES 64 /* per CPU, power of two */
+
+/* Two level page table: PAGING_PGD_ENTRIES leaf tables of 1 << PAGING_PTE_SHIFT
+ * PTEs each, together covering all PAGING_MAX_PGN pages */
+#define PAGING_PTE_SHIFT 7
+#define PAGING_PGD_ENTRIES 128
 
 typedef char BYTE;
 typedef uint32_t addr_t;
@@ -15,6 +24,35 @@ struct pgn_t{
    struct pgn_t *pg_next; 
 };
 
+/*
+ *  Ring of page numbers, used by the page replacement policies
+ */
+struct pgn_ring {
+   int *pgn;
+   int head;
+   int size;
+   int capacity;
+};
+
+#define REPL_NR_QUEUES 3
+
+/*
+ *  Software TLB of one CPU, see mm-tlb.c
+ */
+struct tlb_entry {
+   uint32_t pid;
+   int pgn;
+   int fpn;
+   uint32_t gen;   /* mm tlb_gen at fill time */
+   uint32_t *ptep; /* NULL if the entry is unused */
+};
+
+struct tlb_struct {
+   struct tlb_entry ent[TLB_NR_ENTRIES];
+   unsigned long nr_hits;
+   unsigned long nr_misses;
+};
+
 /*
  *  Memory region struct
  */
@@ -23,15 +61,22 @@ struct vm_rg_struct {
    unsigned long rg_end;
 
    struct vm_rg_struct *rg_next;
+
+   /* Free regions only: linkage in the VMA's address and size indexes */
+   struct rb_node rg_addr_node;
+   struct rb_node rg_size_node;
 };
 
 /*
  *  Memory area struct
  */
+#define VM_POPULATE 0x1 /* back pages with frames as soon as the area grows */
+
 struct vm_area_struct {
    unsigned long vm_id;
    unsigned long vm_start;
    unsigned long vm_end;
+   unsigned long vm_flags;
 
    unsigned long sbrk;
 /*
@@ -39,23 +84,38 @@ struct vm_area_struct {
  * unsigned long vm_limit = vm_end - vm_start
  */
    struct mm_struct *vm_mm;
-   struct vm_rg_struct *vm_freerg_list;
+   /* Free regions, by start address for coalescing and by (size,
+    * start) for best fit. They never overlap nor touch each other */
+   struct rb_root vm_freerg_addr;
+   struct rb_root vm_freerg_size;
    struct vm_area_struct *vm_next;
 };
 
 /* 
  * Memory management struct
+ *
+ * Lock order: mm_lock, then a memphy lock. The memphy locks are leaf
+ * locks, no two of them are ever held at the same time.
  */
 struct mm_struct {
-   uint32_t *pgd;
+   /* Guards the page table, VMAs, free regions and replacement state */
+   pthread_mutex_t mm_lock;
+
+   /* Leaf tables of the page table, NULL until a page in their range is
+    * used. Use pte_lookup() and pte_alloc() rather than indexing them */
+   uint32_t *pgd[PAGING_PGD_ENTRIES];
 
    struct vm_area_struct *mmap;
 
    /* Currently we support a fixed number of symbol */
    struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
 
-   /* list of free page */
-   struct pgn_t *fifo_pgn;
+   /* Resident pages as seen by the replacement policy */
+   struct pgn_ring repl_q[REPL_NR_QUEUES];
+   unsigned long *repl_ghost;
+
+   /* Bumped whenever a cached translation may have become stale */
+   uint32_t tlb_gen;
 };
 
 /*
@@ -78,8 +138,30 @@ struct memphy_struct {
    int rdmflg;
    int cursor;
 
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
+   /* Access statistics, seek_dist counts the cells the head travelled.
+    * nr_read and nr_written are bumped with __atomic builtins */
+   unsigned long nr_read;
+   unsigned long nr_written;
+   unsigned long seek_dist;
+
+   /* Cost of an access: latency time slots, plus one slot per bandwidth
+    * bytes moved. 0 means free */
+   int latency;
+   int bandwidth;
+
+   /* Guards the frame allocator and the cursor of sequential devices */
+   pthread_mutex_t lock;
+
+   /* Management structure: one bit per frame, set while the frame is
+    * in use. fp_hint is a lower bound of the first free frame */
+   unsigned long *fp_bitmap;
+   int maxfp;
+   int nr_freefp;
+   int fp_hint;
+
+   /* RAM only: swap entry still holding a valid copy of each frame,
+    * or -1. A clean page with a copy is evicted without a write back */
+   int *fp_swpslot;
    struct framephy_struct *used_fp_list;
 };
 
@@ -4,11 +4,16 @@
 
 #include "common.h"
 
+/* Initial capacity, a queue grows on demand past it */
 #define MAX_QUEUE_SIZE 20
 
+/* FIFO ring buffer: proc[head] is the oldest entry. A zeroed queue_t is
+ * a valid empty queue */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;
+	int head;
 	int size;
+	int capacity;
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
@@ -17,5 +22,13 @@ struct pcb_t * dequeue(struct queue_t * q);
 
 int empty(struct queue_t * q);
 
+/* Move every process of [src] to the tail of [dst], keeping their order.
+ * Return the number of moved processes */
+int queue_drain(struct queue_t * dst, struct queue_t * src);
+
+/* Remove every entry of [proc] from [q], keeping the order of the others.
+ * Return the number of removed entries */
+int queue_remove(struct queue_t * q, struct pcb_t * proc);
+
 #endif
 
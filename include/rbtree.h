@@ -2,9 +2,65 @@
 #define RBTREE_H
 
 #include <stdlib.h>
+#include <stddef.h>
 
 typedef enum { RED, BLACK } Color;
 
+/*
+ * Intrusive red-black tree: struct rb_node is embedded in the object that
+ * is kept in the tree, so insert and erase never touch the heap. Callers
+ * recover the object with rb_entry().
+ */
+struct rb_node {
+    struct rb_node* left;
+    struct rb_node* right;
+    struct rb_node* parent;
+    Color color;
+};
+
+struct rb_root {
+    struct rb_node* rb_node;
+};
+
+/* Root that also caches the leftmost node, making rb_first_cached() O(1) */
+struct rb_root_cached {
+    struct rb_root rb_root;
+    struct rb_node* rb_leftmost;
+};
+
+#define RB_ROOT         (struct rb_root) { NULL }
+#define RB_ROOT_CACHED  (struct rb_root_cached) { { NULL }, NULL }
+
+#define rb_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define RB_EMPTY_ROOT(root)   ((root)->rb_node == NULL)
+#define rb_first_cached(root) ((root)->rb_leftmost)
+
+// Ordering used by rb_add/rb_add_cached: non-zero if a sorts before b
+typedef int (*RBLess)(const struct rb_node*, const struct rb_node*);
+
+/* Link @node as child @link of @parent, then rebalance with rb_insert_color */
+static inline void rb_link_node(struct rb_node* node, struct rb_node* parent,
+                                struct rb_node** link) {
+    node->parent = parent;
+    node->left = node->right = NULL;
+    node->color = RED;
+    *link = node;
+}
+
+void rb_insert_color(struct rb_node* node, struct rb_root* root);
+void rb_erase(struct rb_node* node, struct rb_root* root);
+void rb_add(struct rb_node* node, struct rb_root* root, RBLess less);
+void rb_add_cached(struct rb_node* node, struct rb_root_cached* root, RBLess less);
+void rb_erase_cached(struct rb_node* node, struct rb_root_cached* root);
+struct rb_node* rb_first(const struct rb_root* root);
+struct rb_node* rb_last(const struct rb_root* root);
+struct rb_node* rb_next(const struct rb_node* node);
+struct rb_node* rb_prev(const struct rb_node* node);
+
+/* Generic tree of opaque data pointers, built on the intrusive core */
+
 // Forward declarations
 typedef struct RBNode RBNode;
 typedef struct RBTree RBTree;
@@ -17,15 +73,12 @@ typedef void (*PrintFunc)(void*);
 
 // Node structure
 struct RBNode {
+    struct rb_node rb;
     void* data;
-    Color color;
-    RBNode* left;
-    RBNode* right;
-    RBNode* parent;
 };
 
 struct RBTree {
-    RBNode* root;
+    struct rb_root root;
     CmpOp cmpop;
     CloneFunc clone_data;
     FreeFunc free_data;
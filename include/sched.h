@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 #include "cfs.h"
@@ -18,7 +18,7 @@
 
 int queue_empty(void);
 
-void init_scheduler(void);
+void init_scheduler(int nr_cpus);
 void finish_scheduler(void);
 
 /* Get the next process from ready queue */
@@ -30,6 +30,19 @@ void put_proc(struct pcb_t * proc);
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
 
+/* Drop a finished process from every list, before its pcb is freed */
+void remove_proc(struct pcb_t * proc);
+
+/* Park a process waiting on a device until slot [wake_at] */
+void block_proc(struct pcb_t * proc, uint64_t wake_at);
+
+/* Requeue the blocked processes due at slot [now] */
+void wake_procs(uint64_t now);
+
+uint64_t next_wake_time(void);
+int nr_blocked_procs(void);
+void blocked_report(void);
+
 #endif
 
 
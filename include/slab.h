@@ -0,0 +1,41 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* Objects are carved out of SLAB_BYTES blocks that are never given back
+ * to malloc. Each thread keeps up to SLAB_MAG_SIZE free objects of every
+ * cache in a magazine, so most allocations and frees take no lock */
+#define SLAB_BYTES 4096
+#define SLAB_MAG_SIZE 16
+#define SLAB_MAX_CACHES 16
+
+struct kmem_cache {
+	const char *name;
+	size_t objsize;
+	int id;			/* magazine slot, 0 until first use */
+
+	pthread_mutex_t lock;	/* guards the depot below */
+	void *freelist;		/* free objects not held by any magazine */
+	void *slabs;		/* blocks, linked through their first word */
+	unsigned long nr_slabs;
+	unsigned long nr_objs;
+	unsigned long nr_active;	/* __atomic, magazines bypass the lock */
+
+	struct kmem_cache *next;
+};
+
+/* Define a cache of objects of @type, usable without any init call */
+#define KMEM_CACHE(var, type) \
+	struct kmem_cache var = { \
+		.name = #type, \
+		.objsize = sizeof(type), \
+		.lock = PTHREAD_MUTEX_INITIALIZER, \
+	}
+
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+void kmem_cache_report(void);
+
+#endif
@@ -28,6 +28,9 @@ struct sc_regs {
         uint32_t orig_ax;
 
         int32_t flags;
+
+        /* Host buffer of the ranged SYSMEM_IO operations */
+        BYTE *buf;
 };
 
 
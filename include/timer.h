@@ -1,16 +1,23 @@
+
 #ifndef TIMER_H
 #define TIMER_H
 
 #include <pthread.h>
 #include <stdint.h>
 
+/* Number of polls a device spins on the slot epoch in next_slot before
+ * blocking on the barrier condvar. 0 blocks right away, which is the
+ * better choice when there are more simulated CPUs than host cores */
+#ifndef TIMER_SPIN_COUNT
+#define TIMER_SPIN_COUNT 0
+#endif
+
+/* Wake-up time of a device that only an action of another device can wake */
+#define TIMER_NEVER UINT64_MAX
+
 struct timer_id_t {
-	int done;
 	int fsh;
-	pthread_cond_t event_cond;
-	pthread_mutex_t event_lock;
-	pthread_cond_t timer_cond;
-	pthread_mutex_t timer_lock;
+	int daemon;	/* background device, see attach_daemon() */
 };
 
 void start_timer();
@@ -19,10 +26,22 @@ void stop_timer();
 
 struct timer_id_t * attach_event();
 
+/* Attach a background device. It takes part in every slot but does not
+ * keep the simulation alive: once all regular devices have detached,
+ * timer_stopped() turns true and the daemon's slot calls stop blocking */
+struct timer_id_t * attach_daemon();
+
+int timer_stopped();
+
 void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
+/* Like next_slot, but the device has nothing to do before slot [wake_at].
+ * When every device is idle the clock jumps to the earliest wake-up */
+void idle_slot(struct timer_id_t* timer_id, uint64_t wake_at);
+
 uint64_t current_time();
 
 #endif
+
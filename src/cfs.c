@@ -1,34 +1,50 @@
-#include "cfs.h" 
+#include "cfs.h"
 #include <pthread.h>
 #include <stdlib.h>
 
-struct cfs_rq cfs_rq;
+struct cfs_rq *cfs_rqs;
+int            cfs_nr_rqs;
 
-static int cfs_cmp(void *a, void *b) {
-    struct pcb_t *p1 = (struct pcb_t*)a;
-    struct pcb_t *p2 = (struct pcb_t*)b;
+/* Tasks queued on all runqueues, so idle CPUs can poll it cheaply */
+static uint32_t cfs_nr_queued;
+
+#define task_of(node) rb_entry(node, struct pcb_t, cfs_ent.run_node)
+
+static int cfs_less(const struct rb_node *a, const struct rb_node *b) {
+    struct pcb_t *p1 = task_of(a);
+    struct pcb_t *p2 = task_of(b);
     uint64_t v1 = p1->cfs_ent.vruntime;
     uint64_t v2 = p2->cfs_ent.vruntime;
-    if (v1 < v2) return -1;
-    if (v1 > v2) return 1;
-    if (p1->pid < p2->pid) return -1;
-    if (p1->pid > p2->pid) return 1;
-    return 0;
+    if (v1 != v2) return v1 < v2;
+    return p1->pid < p2->pid;
 }
-static struct pcb_t *cfs_tree_min(void) {
-    RBNode *node = cfs_rq.tree->root;
-    if (!node) return NULL;
-    while (node->left)
-        node = node->left;
-    struct pcb_t * temp=(struct pcb_t*)node->data;
-    cfs_dequeue((struct pcb_t*)node->data);
-    return temp;
+
+/* Leftmost task: the next one to run, cached so this is O(1).
+ * Caller holds rq->rq_lock */
+static struct pcb_t *cfs_tree_min(struct cfs_rq *rq) {
+    struct rb_node *node = rb_first_cached(&rq->tasks_timeline);
+    return node ? task_of(node) : NULL;
 }
 
-void cfs_init_rq(void) {
-    cfs_rq.tree = new_rbtree(cfs_cmp, NULL, NULL);
-    cfs_rq.total_weight = 0;
-    pthread_mutex_init(&cfs_rq.rq_lock, NULL);
+/* Rightmost task: the one that can best afford to migrate. Caller holds rq->rq_lock */
+static struct pcb_t *cfs_tree_max(struct cfs_rq *rq) {
+    struct rb_node *node = rb_last(&rq->tasks_timeline.rb_root);
+    return node ? task_of(node) : NULL;
+}
+
+void cfs_init_rq(int nr_cpus) {
+    int i;
+    if (nr_cpus < 1) nr_cpus = 1;
+    cfs_rqs = calloc(nr_cpus, sizeof(struct cfs_rq));
+    cfs_nr_rqs = nr_cpus;
+    for (i = 0; i < nr_cpus; i++) {
+        cfs_rqs[i].tasks_timeline = RB_ROOT_CACHED;
+        cfs_rqs[i].total_weight = 0;
+        cfs_rqs[i].min_vruntime = 0;
+        cfs_rqs[i].nr_running = 0;
+        cfs_rqs[i].last_balance = 0;
+        pthread_mutex_init(&cfs_rqs[i].rq_lock, NULL);
+    }
 }
 
 uint32_t cfs_compute_weight(int nice) {
@@ -37,30 +53,155 @@ uint32_t cfs_compute_weight(int nice) {
     return (uint32_t)(WEIGHT_NORM << ((-nice) / 10));
 }
 
-void cfs_enqueue(struct pcb_t *p) {
+/* Caller holds rq->rq_lock */
+void cfs_enqueue(struct cfs_rq *rq, struct pcb_t *p) {
+
+    rb_add_cached(&p->cfs_ent.run_node, &rq->tasks_timeline, cfs_less);
+    rq->total_weight += p->cfs_ent.weight;
+    rq->nr_running++;
+    __atomic_add_fetch(&cfs_nr_queued, 1, __ATOMIC_RELEASE);
+}
+
+/* Caller holds rq->rq_lock */
+void cfs_dequeue(struct cfs_rq *rq, struct pcb_t *p) {
+
+    rb_erase_cached(&p->cfs_ent.run_node, &rq->tasks_timeline);
+    rq->total_weight -= p->cfs_ent.weight;
+    rq->nr_running--;
+    __atomic_sub_fetch(&cfs_nr_queued, 1, __ATOMIC_RELEASE);
+}
+
+/* Least loaded runqueue, an unlocked hint like in cfs_load_balance() */
+static struct cfs_rq *cfs_idlest_rq(void) {
+    struct cfs_rq *rq = &cfs_rqs[0];
+    int i;
+
+    for (i = 1; i < cfs_nr_rqs; i++)
+        if (cfs_rqs[i].total_weight < rq->total_weight)
+            rq = &cfs_rqs[i];
+    return rq;
+}
+
+/* Place a new task on the least loaded runqueue, starting it at that
+ * queue's min_vruntime so it neither starves nor monopolises the CPU */
+void cfs_add_task(struct pcb_t *p) {
+    struct cfs_rq *rq = cfs_idlest_rq();
 
-    rbtree_insert(cfs_rq.tree, p);
-    cfs_rq.total_weight += p->cfs_ent.weight;
+    pthread_mutex_lock(&rq->rq_lock);
+    p->cfs_ent.vruntime = rq->min_vruntime;
+    cfs_enqueue(rq, p);
+    pthread_mutex_unlock(&rq->rq_lock);
+}
+
+/* Put back a task that is on no runqueue, for callers not bound to a CPU.
+ * A task that slept, e.g. on a device, is lifted to the queue's
+ * min_vruntime so it cannot starve the others while it catches up */
+void cfs_requeue_task(struct pcb_t *p) {
+    struct cfs_rq *rq = cfs_idlest_rq();
 
+    pthread_mutex_lock(&rq->rq_lock);
+    if (p->cfs_ent.vruntime < rq->min_vruntime)
+        p->cfs_ent.vruntime = rq->min_vruntime;
+    cfs_enqueue(rq, p);
+    pthread_mutex_unlock(&rq->rq_lock);
 }
 
-void cfs_dequeue(struct pcb_t *p) {
+/*
+ * cfs_load_balance - pull tasks from the busiest runqueue onto @cpu's.
+ *
+ * The highest-vruntime tasks are stolen first since they are the least
+ * cache-hot and the furthest from running on their old CPU. Their vruntime
+ * is renormalised against the destination queue's min_vruntime.
+ *
+ * Returns the number of migrated tasks.
+ */
+int cfs_load_balance(int cpu) {
+    struct cfs_rq *this_rq = &cfs_rqs[cpu];
+    struct cfs_rq *busiest = NULL;
+    struct cfs_rq *first, *second;
+    uint32_t imbalance;
+    int i, moved = 0;
+
+    this_rq->last_balance = current_time();
+
+    /* Unlocked scan, the counts are only a hint and get rechecked below */
+    for (i = 0; i < cfs_nr_rqs; i++) {
+        if (i == cpu)
+            continue;
+        if (!busiest || cfs_rqs[i].nr_running > busiest->nr_running)
+            busiest = &cfs_rqs[i];
+    }
+    if (!busiest || busiest->nr_running <= this_rq->nr_running)
+        return 0;
+
+    /* Always lock runqueues in index order to avoid ABBA deadlocks */
+    first  = (busiest < this_rq) ? busiest : this_rq;
+    second = (busiest < this_rq) ? this_rq : busiest;
+    pthread_mutex_lock(&first->rq_lock);
+    pthread_mutex_lock(&second->rq_lock);
+
+    if (busiest->nr_running > this_rq->nr_running) {
+        imbalance = (busiest->nr_running - this_rq->nr_running + 1) / 2;
+        if (imbalance > CFS_MIGRATE_MAX)
+            imbalance = CFS_MIGRATE_MAX;
+
+        while (moved < imbalance) {
+            struct pcb_t *p = cfs_tree_max(busiest);
+            if (!p)
+                break;
+            cfs_dequeue(busiest, p);
+            if (p->cfs_ent.vruntime > busiest->min_vruntime)
+                p->cfs_ent.vruntime -= busiest->min_vruntime;
+            else
+                p->cfs_ent.vruntime = 0;
+            p->cfs_ent.vruntime += this_rq->min_vruntime;
+            cfs_enqueue(this_rq, p);
+            moved++;
+        }
+    }
 
-    rbtree_delete(cfs_rq.tree, p);
-    cfs_rq.total_weight -= p->cfs_ent.weight;
+    pthread_mutex_unlock(&second->rq_lock);
+    pthread_mutex_unlock(&first->rq_lock);
+    return moved;
 }
 
-struct pcb_t *cfs_pick_next(void) {
+struct pcb_t *cfs_pick_next(int cpu) {
+    struct cfs_rq *rq = &cfs_rqs[cpu];
     struct pcb_t *p;
-    pthread_mutex_lock(&cfs_rq.rq_lock);
-    p = cfs_tree_min();
-    pthread_mutex_unlock(&cfs_rq.rq_lock);
+
+    if (cfs_nr_rqs > 1 &&
+        (rq->nr_running == 0 ||
+         current_time() - rq->last_balance >= CFS_BALANCE_INTERVAL))
+        cfs_load_balance(cpu);
+
+    pthread_mutex_lock(&rq->rq_lock);
+    p = cfs_tree_min(rq);
+    if (p) {
+        cfs_dequeue(rq, p);
+        if (p->cfs_ent.vruntime > rq->min_vruntime)
+            rq->min_vruntime = p->cfs_ent.vruntime;
+    }
+    pthread_mutex_unlock(&rq->rq_lock);
     return p;
 }
 
-uint64_t cfs_timeslice(struct pcb_t *p, uint32_t extern_weight) {
-    uint64_t total = (cfs_rq.total_weight + extern_weight) ? (cfs_rq.total_weight + extern_weight) : 1;
-    uint64_t slice = (SCHED_LATENCY_NSEC * p->cfs_ent.weight) / total;
+/* Next task of the busiest runqueue, for callers not bound to a CPU */
+struct pcb_t *cfs_pick_any(void) {
+    int i, busiest = 0;
+
+    for (i = 1; i < cfs_nr_rqs; i++)
+        if (cfs_rqs[i].nr_running > cfs_rqs[busiest].nr_running)
+            busiest = i;
+    return cfs_pick_next(busiest);
+}
+
+uint32_t cfs_nr_running(void) {
+    return __atomic_load_n(&cfs_nr_queued, __ATOMIC_ACQUIRE);
+}
+
+uint64_t cfs_timeslice(int cpu, struct pcb_t *p, uint32_t extern_weight) {
+    uint64_t total = cfs_rqs[cpu].total_weight + extern_weight;
+    uint64_t slice = (SCHED_LATENCY_NSEC * p->cfs_ent.weight) / (total ? total : 1);
     return (slice < MIN_GRANULARITY_NSEC ? MIN_GRANULARITY_NSEC : slice);
 }
 
@@ -70,9 +211,12 @@ void cfs_update_vruntime(struct pcb_t *p, uint64_t delta_ns) {
                             / (p->cfs_ent.weight ?: WEIGHT_NORM);
 }
 
-void cfs_task_tick(struct pcb_t *p, uint64_t elapsed_ns) {
+/* The running task is off the tree, charge it and put it back on @cpu's queue */
+void cfs_task_tick(int cpu, struct pcb_t *p, uint64_t elapsed_ns) {
+    struct cfs_rq *rq = &cfs_rqs[cpu];
     if (!p) return;
-    cfs_dequeue(p);
     cfs_update_vruntime(p, elapsed_ns);
-    cfs_enqueue(p);
+    pthread_mutex_lock(&rq->rq_lock);
+    cfs_enqueue(rq, p);
+    pthread_mutex_unlock(&rq->rq_lock);
 }
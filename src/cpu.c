@@ -78,6 +78,117 @@ int write(struct pcb_t *proc, BYTE data, uint32_t destination, uint32_t offset)
 return write_mem(proc->regs[destination] + offset, proc, data);
 }
 
+/**
+ * readb - Read a block of memory, the bytes are discarded.
+ * @proc: Pointer to the process control block.
+ * @source: Region (register) holding the block.
+ * @offset: Offset of the block.
+ * @len: Number of bytes.
+ *
+ * Returns 0 on success, nonzero on error.
+ */
+int readb(struct pcb_t *proc, uint32_t source, uint32_t offset, uint32_t len)
+{
+BYTE buf[PAGING_PAGESZ];
+uint32_t done, chunk;
+
+/* At most a page per step, the way lib*_range move the data anyway */
+for (done = 0; done < len; done += chunk) {
+    chunk = (len - done < PAGING_PAGESZ) ? len - done : PAGING_PAGESZ;
+#ifdef MM_PAGING
+    if (libread_range(proc, source, offset + done, buf, chunk) != 0)
+        return 1;
+#else
+    uint32_t i;
+    for (i = 0; i < chunk; i++)
+        if (read_mem(proc->regs[source] + offset + done + i, proc, &buf[i]) != 0)
+            return 1;
+#endif
+}
+return 0;
+}
+
+/**
+ * writeb - Write a block of bytes to memory.
+ * @proc: Pointer to the process control block.
+ * @data: Bytes to write.
+ * @destination: Region (register) receiving the block.
+ * @offset: Offset of the block.
+ * @len: Number of bytes.
+ *
+ * Returns 0 on success, nonzero on error.
+ */
+int writeb(struct pcb_t *proc, const BYTE *data, uint32_t destination,
+           uint32_t offset, uint32_t len)
+{
+#ifdef MM_PAGING
+return libwrite_range(proc, data, destination, offset, len) != 0;
+#else
+uint32_t i;
+for (i = 0; i < len; i++)
+    if (write_mem(proc->regs[destination] + offset + i, proc, data[i]) != 0)
+        return 1;
+return 0;
+#endif
+}
+
+/**
+ * copyb - Copy a block of memory, overlapping blocks are allowed.
+ * @proc: Pointer to the process control block.
+ * @source: Region (register) holding the source block.
+ * @srcoff: Offset of the source block.
+ * @destination: Region (register) receiving the copy.
+ * @dstoff: Offset of the destination block.
+ * @len: Number of bytes.
+ *
+ * Returns 0 on success, nonzero on error.
+ */
+int copyb(struct pcb_t *proc, uint32_t source, uint32_t srcoff,
+          uint32_t destination, uint32_t dstoff, uint32_t len)
+{
+#ifdef MM_PAGING
+return libcopy(proc, source, srcoff, destination, dstoff, len) != 0;
+#else
+addr_t src = proc->regs[source] + srcoff;
+addr_t dst = proc->regs[destination] + dstoff;
+uint32_t i;
+BYTE data;
+
+/* Byte by byte, backwards when the destination overlaps the tail */
+for (i = 0; i < len; i++) {
+    uint32_t k = (dst > src) ? len - 1 - i : i;
+    if (read_mem(src + k, proc, &data) != 0 ||
+        write_mem(dst + k, proc, data) != 0)
+        return 1;
+}
+return 0;
+#endif
+}
+
+/**
+ * fillb - Set a block of memory to one byte value.
+ * @proc: Pointer to the process control block.
+ * @value: Byte value.
+ * @destination: Region (register) receiving the block.
+ * @offset: Offset of the block.
+ * @len: Number of bytes.
+ *
+ * Returns 0 on success, nonzero on error.
+ */
+int fillb(struct pcb_t *proc, BYTE value, uint32_t destination,
+          uint32_t offset, uint32_t len)
+{
+#ifdef MM_PAGING
+return libfill(proc, value, destination, offset, len) != 0;
+#else
+uint32_t i;
+for (i = 0; i < len; i++)
+    if (write_mem(proc->regs[destination] + offset + i, proc, value) != 0)
+        return 1;
+return 0;
+#endif
+}
+
 /**
  * run - Execute one instruction from the process code.
  * @proc: Pointer to the process control block.
@@ -126,6 +237,18 @@ switch (ins.opcode)
         stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
 #endif
         break;
+    case READB:
+        stat = readb(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+        break;
+    case WRITEB:
+        stat = writeb(proc, (BYTE *)ins.data, ins.arg_1, ins.arg_2, ins.arg_0);
+        break;
+    case COPYB:
+        stat = copyb(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3, ins.arg_4);
+        break;
+    case FILLB:
+        stat = fillb(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
+        break;
     case SYSCALL:
         stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
         break;
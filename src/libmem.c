@@ -18,53 +18,106 @@
 #include <pthread.h>
 #include "../include/syscall.h"
 #define DEBUG_PRINT
-/* Global mutex to ensure thread-safe modifications of VM structures. */
-static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Locking: every entry point takes caller->mm->mm_lock for the page table
+ * and VM structures of that process only, so processes on different CPUs
+ * do not serialize. Frame allocation takes the per-memphy lock inside
+ * MEMPHY_get_freefp/MEMPHY_put_freefp, always after mm_lock.
+ */
+
+#define rg_of_addr(n) rb_entry(n, struct vm_rg_struct, rg_addr_node)
+#define rg_of_size(n) rb_entry(n, struct vm_rg_struct, rg_size_node)
+#define rg_size(rg)   ((rg)->rg_end - (rg)->rg_start)
+
+static int freerg_addr_less(const struct rb_node *a, const struct rb_node *b)
+{
+    return rg_of_addr(a)->rg_start < rg_of_addr(b)->rg_start;
+}
+
+static int freerg_size_less(const struct rb_node *a, const struct rb_node *b)
+{
+    struct vm_rg_struct *r1 = rg_of_size(a);
+    struct vm_rg_struct *r2 = rg_of_size(b);
+
+    if (rg_size(r1) != rg_size(r2))
+        return rg_size(r1) < rg_size(r2);
+    return r1->rg_start < r2->rg_start;
+}
+
+/* Smallest free region of at least @size bytes, lowest address first */
+static struct vm_rg_struct *freerg_best_fit(struct vm_area_struct *vma, int size)
+{
+    struct rb_node *n = vma->vm_freerg_size.rb_node;
+    struct vm_rg_struct *best = NULL;
+
+    while (n) {
+        struct vm_rg_struct *rg = rg_of_size(n);
+        if (rg_size(rg) >= (unsigned long)size) {
+            best = rg;
+            n = n->left;
+        } else {
+            n = n->right;
+        }
+    }
+    return best;
+}
+
+/* Drop @rg from both indexes and release it */
+static void freerg_remove(struct vm_area_struct *vma, struct vm_rg_struct *rg)
+{
+    rb_erase(&rg->rg_addr_node, &vma->vm_freerg_addr);
+    rb_erase(&rg->rg_size_node, &vma->vm_freerg_size);
+    kmem_cache_free(&vm_rg_cache, rg);
+}
 
 /**
 * enlist_vm_freerg_list - Adds a new free region to the VM area's free list.
 * @mm: Pointer to the memory management structure.
 * @rg_elmt: The vm_rg_struct element to add.
 *
+* The region is merged with the free regions it touches or overlaps, whose
+* nodes are released; @rg_elmt itself may be freed. O(log n) per merge.
+*
 * Returns 0 on success or -1 if the region is invalid.
 */
-
-/**
- * Enlist for merge freerg_list
- */
 int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt)
 {
-    struct vm_rg_struct **pp = &mm->mmap->vm_freerg_list;
-    struct vm_rg_struct  *cur = mm->mmap->vm_freerg_list;
+    struct vm_area_struct *vma = mm->mmap;
+    struct vm_rg_struct *rg = rg_elmt;
+    struct rb_node *prev, *next;
 
     if (rg_elmt->rg_start >= rg_elmt->rg_end)
         return -1;
 
-    while (cur && cur->rg_start < rg_elmt->rg_start) {
-        pp  = &cur->rg_next;
-        cur =  cur->rg_next;
+    rb_add(&rg->rg_addr_node, &vma->vm_freerg_addr, freerg_addr_less);
+
+    prev = rb_prev(&rg->rg_addr_node);
+    if (prev && rg_of_addr(prev)->rg_end >= rg->rg_start) {
+        struct vm_rg_struct *left = rg_of_addr(prev);
+
+        /* Grow the left neighbour, it is resized so leaves the size index */
+        rb_erase(&left->rg_size_node, &vma->vm_freerg_size);
+        if (left->rg_end < rg->rg_end)
+            left->rg_end = rg->rg_end;
+        rb_erase(&rg->rg_addr_node, &vma->vm_freerg_addr);
+        kmem_cache_free(&vm_rg_cache, rg);
+        rg = left;
     }
 
-    rg_elmt->rg_next = cur;
-    *pp               = rg_elmt;
-
-    struct vm_rg_struct *iter = mm->mmap->vm_freerg_list;
-    while (iter && iter->rg_next) {
-        if (iter->rg_end >= iter->rg_next->rg_start) {
-            if (iter->rg_end < iter->rg_next->rg_end) {
-                iter->rg_end = iter->rg_next->rg_end;
-            }
-            struct vm_rg_struct *tmp = iter->rg_next;
-            iter->rg_next = tmp->rg_next;
-        } else {
-            iter = iter->rg_next;
-        }
+    while ((next = rb_next(&rg->rg_addr_node)) &&
+           rg_of_addr(next)->rg_start <= rg->rg_end) {
+        struct vm_rg_struct *right = rg_of_addr(next);
+
+        if (rg->rg_end < right->rg_end)
+            rg->rg_end = right->rg_end;
+        freerg_remove(vma, right);
     }
 
+    rb_add(&rg->rg_size_node, &vma->vm_freerg_size, freerg_size_less);
     return 0;
 }
 
-
 /**
 * get_symrg_byid - Retrieves a symbol region from the region table.
 * @mm: Pointer to the memory management structure.
@@ -99,20 +152,22 @@ int __alloc(struct pcb_t *caller,
             int size,
             int *alloc_addr)
 {
-    pthread_mutex_lock(&mmvm_lock);
+    pthread_mutex_lock(&caller->mm->mm_lock);
 
     struct vm_rg_struct rgnode;
     if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0) {
         caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
         caller->mm->symrgtbl[rgid].rg_end   = rgnode.rg_end;
         *alloc_addr                         = rgnode.rg_start;
-    //Swap page in
-    int start_page = rgnode.rg_start / PAGE_SIZE;
-    int end_page = rgnode.rg_end / PAGE_SIZE;
-    int pgn, fpn;
-    for (int i = start_page; i <= end_page; i++) {
-      pg_getpage(caller->mm, i, &fpn, caller);
-    }
+        /* Eagerly populated areas also bring swapped pages back now,
+         * otherwise every page is faulted in on first touch */
+        struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+        if (cur_vma && (cur_vma->vm_flags & VM_POPULATE)) {
+            int pgn, fpn;
+            for (pgn = PAGING_PGN(rgnode.rg_start);
+                 pgn <= PAGING_PGN(rgnode.rg_end - 1); pgn++)
+                pg_getpage(caller->mm, pgn, &fpn, caller);
+        }
 #ifdef DEBUG_PRINT
         printf("===== PHYSICAL MEMORY AFTER ALLOCATION =====\n");
         printf("PID=%d - Region=%d - Address=%08x - Size=%d byte\n",
@@ -121,11 +176,11 @@ int __alloc(struct pcb_t *caller,
         printf("================================================================\n");
 #endif
 
-        pthread_mutex_unlock(&mmvm_lock);
+        pthread_mutex_unlock(&caller->mm->mm_lock);
         return 0;
     }
 
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->mm->mm_lock);
     return -1;
 }
 
@@ -147,22 +202,23 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
   if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
     return -1;
 
-  struct vm_rg_struct *rgnode = malloc(sizeof(struct vm_rg_struct));
+  struct vm_rg_struct *rgnode = kmem_cache_alloc(&vm_rg_cache);
   if (!rgnode)
     return -1;
+  pthread_mutex_lock(&caller->mm->mm_lock);
   rgnode->rg_start = caller->mm->symrgtbl[rgid].rg_start;
   rgnode->rg_end   = caller->mm->symrgtbl[rgid].rg_end;
   rgnode->rg_next  = NULL;
 
-  pthread_mutex_lock(&mmvm_lock);
   if (enlist_vm_freerg_list(caller->mm, rgnode) != 0) {
-    free(rgnode);
-    pthread_mutex_unlock(&mmvm_lock);
+    kmem_cache_free(&vm_rg_cache, rgnode);
+    pthread_mutex_unlock(&caller->mm->mm_lock);
     return -1;
   }
   caller->mm->symrgtbl[rgid].rg_start = 0;
   caller->mm->symrgtbl[rgid].rg_end   = 0;
-  pthread_mutex_unlock(&mmvm_lock);
+  tlb_flush_mm(caller->mm);
+  pthread_mutex_unlock(&caller->mm->mm_lock);
   return 0;
 }
 
@@ -195,10 +251,13 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
 }
 
 /**
-* pg_getpage - Ensure the target page is in RAM, swapping it in if necessary.
+* pg_getpage - Ensure the target page is in RAM, faulting it in if necessary.
 *
-* If the page is not present, it selects a victim page, swaps the victim's
-* content out, and maps in the required page.
+* A page that is not present is either swapped out, and is copied back, or
+* has never been touched, and gets a zeroed frame (demand paging). The frame
+* is a free one when RAM has any left, otherwise a victim page is swapped out
+* to make room. Swapped-in pages keep their swap frame, so they can later be
+* evicted without a copy as long as they stay clean.
 *
 * @mm: Pointer to the memory management structure.
 * @pgn: The virtual page number.
@@ -209,40 +268,70 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
 */
 int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
 {
-  uint32_t pte = mm->pgd[pgn];
+  uint32_t *ptep = pte_lookup(mm, pgn);
+  uint32_t pte = ptep ? *ptep : 0;
 
   if (!PAGING_PAGE_PRESENT(pte)) {
-    int vicpgn, swpfpn, vicfpn, tgtfpn;
-    if (find_victim_page(caller->mm, &vicpgn) != 0)
-      return -1;
-
-    uint32_t vicpte = mm->pgd[vicpgn];
-    vicfpn = PAGING_FPN(vicpte);
+    int vicpgn, swpent, tgtfpn, tgtswp;
 
-    if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) != 0)
+    /* An untouched page must still lie inside the address space */
+    if (!(pte & PAGING_PTE_SWAPPED_MASK) &&
+        find_vma(mm, pgn * PAGING_PAGESZ) == NULL)
+      return -1;
+    if (ptep == NULL && (ptep = pte_alloc(mm, pgn)) == NULL)
       return -1;
 
-    tgtfpn = PAGING_PTE_FPN(pte);
+    repl_page_fault();
+    if (MEMPHY_get_freefp(caller->mram, &tgtfpn) != 0) {
+      if (find_victim_page(mm, &vicpgn) != 0)
+        return -1;
+      uint32_t *vicpte = pte_lookup(mm, vicpgn);
+      tgtfpn = PAGING_FPN(*vicpte);
 
-    struct sc_regs regs;
-    regs.a1 = SYSMEM_SWP_OP;
-    regs.a2 = vicfpn;
-    regs.a3 = swpfpn;
-    if (__sys_memmap(caller, &regs) != 0)
-      return -1;
+      /* Reuse the swap copy of the victim if it has one, and only write
+       * it back if the page was modified since */
+      swpent = caller->mram->fp_swpslot[tgtfpn];
+      if (swpent < 0 || (*vicpte & PAGING_PTE_DIRTY_MASK)) {
+        struct sc_regs regs;
+        regs.a1 = SYSMEM_SWP_OP;
+        regs.a2 = tgtfpn;
+        regs.a3 = swpent;
+        if (__sys_memmap(caller, &regs) != 0) {
+          /* The victim stays, clean if its copy got written anyway */
+          swpent = (int)regs.a3;
+          caller->mram->fp_swpslot[tgtfpn] = swpent;
+          if (swpent >= 0)
+            CLRBIT(*vicpte, PAGING_PTE_DIRTY_MASK);
+          repl_page_mapped(mm, vicpgn);
+          return -1;
+        }
+        swpent = (int)regs.a3;
+        repl_page_writeback(1);
+      }
+      CLRBIT(*vicpte, PAGING_PTE_DIRTY_MASK);
+      pte_set_swap(vicpte, SWP_TYPE(swpent), SWP_OFFSET(swpent));
+      caller->mram->fp_swpslot[tgtfpn] = -1;
+    }
 
-    regs.a1 = SYSMEM_SWP_OP;
-    regs.a2 = tgtfpn;
-    regs.a3 = vicfpn;
-    if (__sys_memmap(caller, &regs) != 0)
-      return -1;
+    if (pte & PAGING_PTE_SWAPPED_MASK) {
+      /* Bring the target page back, its swap slot keeps a clean copy */
+      tgtswp = PAGING_PTE_SWPENT(pte);
+      if (swap_read_page(tgtswp, caller->mram, tgtfpn) != 0) {
+        /* The frame is unmapped either way, give it back */
+        MEMPHY_put_freefp(caller->mram, tgtfpn);
+        return -1;
+      }
+      caller->mram->fp_swpslot[tgtfpn] = tgtswp;
+    } else {
+      MEMPHY_zero_frame(caller->mram, tgtfpn);
+    }
 
-    pte_set_swap(&mm->pgd[vicfpn], 0, swpfpn);
-    pte_set_fpn(&mm->pgd[pgn], vicfpn);
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+    pte_set_fpn(ptep, tgtfpn);
+    CLRBIT(*ptep, PAGING_PTE_DIRTY_MASK);
+    repl_page_mapped(mm, pgn);
   }
 
-  *fpn = PAGING_FPN(mm->pgd[pgn]);
+  *fpn = PAGING_FPN(*ptep);
   return 0;
 }
 
@@ -265,15 +354,36 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
   int off = PAGING_OFFST(addr);
   int fpn;
 
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+  uint32_t *ptep;
+
+  pthread_mutex_lock(&mm->mm_lock);
+
+  /* TLB hit: the page is resident, access the frame directly */
+  if (caller->tlb != NULL &&
+      (ptep = tlb_lookup(caller->tlb, caller, pgn, &fpn)) != NULL) {
+    int ret;
+    SETBIT(*ptep, PAGING_PTE_ACCESSED_MASK);
+    ret = MEMPHY_read(caller->mram, fpn * PAGING_PAGESZ + off, data);
+    pthread_mutex_unlock(&mm->mm_lock);
+    return ret;
+  }
+
+  if (pg_getpage(mm, pgn, &fpn, caller) != 0) {
+    pthread_mutex_unlock(&mm->mm_lock);
     return -1; /* invalid page access */
+  }
+  SETBIT(*pte_lookup(mm, pgn), PAGING_PTE_ACCESSED_MASK);
+  if (caller->tlb != NULL)
+    tlb_insert(caller->tlb, caller, pgn, fpn);
 
   int phyaddr = (fpn * PAGING_PAGESZ) + off;
   struct sc_regs regs;
   regs.a1 = SYSMEM_IO_READ;
   regs.a2 = phyaddr;
   regs.a3 = 0;
-  if (__sys_memmap(caller, &regs) != 0)
+  int ret = __sys_memmap(caller, &regs);
+  pthread_mutex_unlock(&mm->mm_lock);
+  if (ret != 0)
     return -1;
   *data = (BYTE)regs.a3;
   return 0;
@@ -298,15 +408,36 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
   int off = PAGING_OFFST(addr);
   int fpn;
 
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+  uint32_t *ptep;
+
+  pthread_mutex_lock(&mm->mm_lock);
+
+  /* TLB hit: the page is resident, access the frame directly */
+  if (caller->tlb != NULL &&
+      (ptep = tlb_lookup(caller->tlb, caller, pgn, &fpn)) != NULL) {
+    int ret;
+    SETBIT(*ptep, PAGING_PTE_ACCESSED_MASK | PAGING_PTE_DIRTY_MASK);
+    ret = MEMPHY_write(caller->mram, fpn * PAGING_PAGESZ + off, value);
+    pthread_mutex_unlock(&mm->mm_lock);
+    return ret;
+  }
+
+  if (pg_getpage(mm, pgn, &fpn, caller) != 0) {
+    pthread_mutex_unlock(&mm->mm_lock);
     return -1; /* invalid page access */
+  }
+  SETBIT(*pte_lookup(mm, pgn), PAGING_PTE_ACCESSED_MASK | PAGING_PTE_DIRTY_MASK);
+  if (caller->tlb != NULL)
+    tlb_insert(caller->tlb, caller, pgn, fpn);
 
   int phyaddr = (fpn * PAGING_PAGESZ) + off;
   struct sc_regs regs;
   regs.a1 = SYSMEM_IO_WRITE;
   regs.a2 = phyaddr;
   regs.a3 = value;
-  if (__sys_memmap(caller, &regs) != 0)
+  int ret = __sys_memmap(caller, &regs);
+  pthread_mutex_unlock(&mm->mm_lock);
+  if (ret != 0)
     return -1;
   return 0;
 }
@@ -444,59 +575,318 @@ int libwrite(struct pcb_t *proc, BYTE data, uint32_t destination, uint32_t offse
 }
 
 /**
-* free_pcb_memph - Frees all physical frames allocated to a process.
+* pg_getframe - Translate a page for an access, faulting it in if needed.
+*
+* The per-page part of pg_getval and pg_setval: the TLB first, then the
+* page table. Caller holds mm->mm_lock.
+*
+* @mm: Pointer to the memory management structure.
+* @pgn: The virtual page number.
+* @write: Nonzero if the page is about to be modified.
+* @fpn: Pointer to store the resulting frame number.
+* @caller: Pointer to the calling process's control block.
+*
+* Returns 0 on success, or -1 on failure.
+*/
+static int pg_getframe(struct mm_struct *mm, int pgn, int write, int *fpn,
+                       struct pcb_t *caller)
+{
+  uint32_t mask = PAGING_PTE_ACCESSED_MASK;
+  uint32_t *ptep;
+
+  if (write)
+    mask |= PAGING_PTE_DIRTY_MASK;
+
+  if (caller->tlb != NULL &&
+      (ptep = tlb_lookup(caller->tlb, caller, pgn, fpn)) != NULL) {
+    SETBIT(*ptep, mask);
+    return 0;
+  }
+
+  if (pg_getpage(mm, pgn, fpn, caller) != 0)
+    return -1;
+  SETBIT(*pte_lookup(mm, pgn), mask);
+  if (caller->tlb != NULL)
+    tlb_insert(caller->tlb, caller, pgn, *fpn);
+  return 0;
+}
+
+/**
+* pg_iorange - Read, write or fill a range of virtual memory.
 *
-* Iterates over the page directory and returns frames to the free pool.
+* Translates once per page and moves the part of the range in that page
+* with a single ranged SYSMEM_IO syscall.
 *
 * @caller: Pointer to the process control block.
+* @addr: First virtual address.
+* @len: Number of bytes.
+* @memop: SYSMEM_IO_READ_RANGE, SYSMEM_IO_WRITE_RANGE or SYSMEM_IO_FILL.
+* @buf: Host buffer of a read or write, NULL for a fill.
+* @value: Byte value of a fill.
 *
-* Returns 0 on success.
+* Returns 0 on success, or -1 on failure.
 */
-int free_pcb_memph(struct pcb_t *caller)
+static int pg_iorange(struct pcb_t *caller, int addr, int len, int memop,
+                      BYTE *buf, BYTE value)
 {
-  int pagenum, fpn;
-  uint32_t pte;
+  struct mm_struct *mm = caller->mm;
+  int done = 0;
+
+  pthread_mutex_lock(&mm->mm_lock);
+  while (done < len) {
+    int cur = addr + done;
+    int off = PAGING_OFFST(cur);
+    int chunk = PAGING_PAGESZ - off;
+    int fpn;
+    struct sc_regs regs;
 
-  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++) {
-    pte = caller->mm->pgd[pagenum];
-    if (!PAGING_PAGE_PRESENT(pte)) {
-      fpn = PAGING_PTE_FPN(pte);
-      MEMPHY_put_freefp(caller->mram, fpn);
+    if (chunk > len - done)
+      chunk = len - done;
+    if (pg_getframe(mm, PAGING_PGN(cur),
+                    memop != SYSMEM_IO_READ_RANGE, &fpn, caller) != 0)
+      break;
+
+    regs.a1 = memop;
+    regs.a2 = fpn * PAGING_PAGESZ + off;
+    regs.a3 = (uint32_t)value;
+    regs.a4 = chunk;
+    regs.buf = buf ? buf + done : NULL;
+    if (__sys_memmap(caller, &regs) != 0)
+      break;
+    done += chunk;
+  }
+  pthread_mutex_unlock(&mm->mm_lock);
+
+  return (done == len) ? 0 : -1;
+}
+
+/**
+* pg_copyrange - Copy a range of virtual memory, memmove style.
+*
+* Chunks never cross a page of either side, each one is a single
+* SYSMEM_IO_COPY. Faulting the destination page in may evict the source
+* one, such a chunk goes through a bounce buffer instead. Overlapping
+* ranges with the destination above the source are copied backwards.
+*
+* @caller: Pointer to the process control block.
+* @src: First source virtual address.
+* @dst: First destination virtual address.
+* @len: Number of bytes.
+*
+* Returns 0 on success, or -1 on failure.
+*/
+static int pg_copyrange(struct pcb_t *caller, int src, int dst, int len)
+{
+  struct mm_struct *mm = caller->mm;
+  int backward = (dst > src && dst < src + len);
+  int done = 0;
+
+  pthread_mutex_lock(&mm->mm_lock);
+  while (done < len) {
+    int chunk = len - done;
+    int s, d, srcfpn, dstfpn, room;
+    uint32_t *srcpte;
+    struct sc_regs regs;
+
+    /* Bytes left in the current page of each side, in copy direction */
+    if (backward) {
+      s = src + len - done - 1;
+      d = dst + len - done - 1;
+      room = PAGING_OFFST(s) + 1;
+      if (chunk > room)
+        chunk = room;
+      room = PAGING_OFFST(d) + 1;
+      if (chunk > room)
+        chunk = room;
+      s -= chunk - 1;
+      d -= chunk - 1;
     } else {
-      fpn = PAGING_PTE_SWP(pte);
-      MEMPHY_put_freefp(caller->active_mswp, fpn);
+      s = src + done;
+      d = dst + done;
+      room = PAGING_PAGESZ - PAGING_OFFST(s);
+      if (chunk > room)
+        chunk = room;
+      room = PAGING_PAGESZ - PAGING_OFFST(d);
+      if (chunk > room)
+        chunk = room;
     }
+
+    if (pg_getframe(mm, PAGING_PGN(s), 0, &srcfpn, caller) != 0 ||
+        pg_getframe(mm, PAGING_PGN(d), 1, &dstfpn, caller) != 0)
+      break;
+
+    srcpte = pte_lookup(mm, PAGING_PGN(s));
+    if (PAGING_PAGE_PRESENT(*srcpte) && PAGING_FPN(*srcpte) == srcfpn) {
+      regs.a1 = SYSMEM_IO_COPY;
+      regs.a2 = srcfpn * PAGING_PAGESZ + PAGING_OFFST(s);
+      regs.a3 = dstfpn * PAGING_PAGESZ + PAGING_OFFST(d);
+      regs.a4 = chunk;
+      if (__sys_memmap(caller, &regs) != 0)
+        break;
+    } else {
+      BYTE bounce[PAGING_PAGESZ];
+
+      if (pg_getframe(mm, PAGING_PGN(s), 0, &srcfpn, caller) != 0)
+        break;
+      regs.a1 = SYSMEM_IO_READ_RANGE;
+      regs.a2 = srcfpn * PAGING_PAGESZ + PAGING_OFFST(s);
+      regs.a4 = chunk;
+      regs.buf = bounce;
+      if (__sys_memmap(caller, &regs) != 0 ||
+          pg_getframe(mm, PAGING_PGN(d), 1, &dstfpn, caller) != 0)
+        break;
+      regs.a1 = SYSMEM_IO_WRITE_RANGE;
+      regs.a2 = dstfpn * PAGING_PAGESZ + PAGING_OFFST(d);
+      if (__sys_memmap(caller, &regs) != 0)
+        break;
+    }
+    done += chunk;
   }
+  pthread_mutex_unlock(&mm->mm_lock);
 
-  return 0;
+  return (done == len) ? 0 : -1;
+}
+
+/* Virtual address of [offset, offset + len) in region @rgid, or -1 if
+ * the range does not fit in the region */
+static int rg_range_addr(struct pcb_t *caller, int rgid, uint32_t offset,
+                         uint32_t len)
+{
+  struct vm_rg_struct *rg = get_symrg_byid(caller->mm, rgid);
+
+  if (rg == NULL || offset + len < offset || rg->rg_start + offset + len > rg->rg_end)
+    return -1;
+  return rg->rg_start + offset;
 }
 
 /**
-* find_victim_page - Implements a FIFO policy to select a victim page.
+* libread_range - Read a range of a region into a host buffer.
 *
-* @mm: Pointer to the memory management structure.
-* @retpgn: Pointer to store the selected victim page number.
+* @proc: Pointer to the process control block.
+* @source: Symbol region ID representing the region.
+* @offset: Offset into the region.
+* @buf: Buffer of at least @len bytes.
+* @len: Number of bytes.
 *
-* Returns 0 on success, or -1 if no victim page is available.
+* Returns 0 on success, or nonzero on failure.
 */
-int find_victim_page(struct mm_struct *mm, int *retpgn)
+int libread_range(struct pcb_t *proc, uint32_t source, uint32_t offset,
+                  BYTE *buf, uint32_t len)
 {
-  struct pgn_t *pg = mm->fifo_pgn;
-  if (pg == NULL)
+  int addr = rg_range_addr(proc, source, offset, len);
+
+  if (addr < 0)
     return -1;
-  
-  *retpgn = pg->pgn;
-  mm->fifo_pgn = pg->pg_next;
-  free(pg);
-  
+  return pg_iorange(proc, addr, len, SYSMEM_IO_READ_RANGE, buf, 0);
+}
+
+/**
+* libwrite_range - Write a host buffer to a range of a region.
+*
+* @proc: Pointer to the process control block.
+* @buf: Bytes to write.
+* @destination: Symbol region ID representing the region.
+* @offset: Offset into the region.
+* @len: Number of bytes.
+*
+* Returns 0 on success, or nonzero on failure.
+*/
+int libwrite_range(struct pcb_t *proc, const BYTE *buf, uint32_t destination,
+                   uint32_t offset, uint32_t len)
+{
+  int addr = rg_range_addr(proc, destination, offset, len);
+
+  if (addr < 0)
+    return -1;
+  return pg_iorange(proc, addr, len, SYSMEM_IO_WRITE_RANGE, (BYTE *)buf, 0);
+}
+
+/**
+* libcopy - Copy a range from one region to another, or within one.
+*
+* @proc: Pointer to the process control block.
+* @source: Source symbol region ID.
+* @srcoff: Offset into the source region.
+* @destination: Destination symbol region ID.
+* @dstoff: Offset into the destination region.
+* @len: Number of bytes.
+*
+* Returns 0 on success, or nonzero on failure.
+*/
+int libcopy(struct pcb_t *proc, uint32_t source, uint32_t srcoff,
+            uint32_t destination, uint32_t dstoff, uint32_t len)
+{
+  int src = rg_range_addr(proc, source, srcoff, len);
+  int dst = rg_range_addr(proc, destination, dstoff, len);
+
+  if (src < 0 || dst < 0)
+    return -1;
+  return pg_copyrange(proc, src, dst, len);
+}
+
+/**
+* libfill - Set a range of a region to one byte value.
+*
+* @proc: Pointer to the process control block.
+* @value: Byte value.
+* @destination: Symbol region ID representing the region.
+* @offset: Offset into the region.
+* @len: Number of bytes.
+*
+* Returns 0 on success, or nonzero on failure.
+*/
+int libfill(struct pcb_t *proc, BYTE value, uint32_t destination,
+            uint32_t offset, uint32_t len)
+{
+  int addr = rg_range_addr(proc, destination, offset, len);
+
+  if (addr < 0)
+    return -1;
+  return pg_iorange(proc, addr, len, SYSMEM_IO_FILL, NULL, value);
+}
+
+/**
+* free_pcb_memph - Frees all physical frames allocated to a process.
+*
+* Visits only the pages in use. A resident page gives back its frame and
+* the swap copy it may still have, a swapped page its swap slot. The PTEs
+* are cleared, so calling this again, e.g. once a killed process exits,
+* releases nothing twice.
+*
+* @caller: Pointer to the process control block.
+*
+* Returns 0 on success.
+*/
+int free_pcb_memph(struct pcb_t *caller)
+{
+  int pagenum, fpn;
+  uint32_t pte, *ptep;
+
+  pthread_mutex_lock(&caller->mm->mm_lock);
+  for_each_mapped_pte(caller->mm, pagenum, ptep) {
+    pte = *ptep;
+    if (PAGING_PAGE_PRESENT(pte)) {
+      fpn = PAGING_PTE_FPN(pte);
+      if (caller->mram->fp_swpslot[fpn] >= 0)
+        swap_put_slot(caller->mram->fp_swpslot[fpn]);
+      MEMPHY_put_freefp(caller->mram, fpn);
+    } else if (pte & PAGING_PTE_SWAPPED_MASK) {
+      swap_put_slot(PAGING_PTE_SWPENT(pte));
+    }
+    *ptep = 0;
+  }
+
+  tlb_flush_mm(caller->mm);
+  pthread_mutex_unlock(&caller->mm->mm_lock);
+
   return 0;
 }
 
 /**
 * get_free_vmrg_area - Searches for an adequately sized free region.
 *
-* Iterates over the free region list of the given VM area until a region of
-* at least 'size' bytes is found. Updates the free list appropriately.
+* Takes the best fit from the size index of the VM area, growing the area
+* once if no free region is large enough. O(log n) in the free regions.
 *
 * @caller: Pointer to the process control block.
 * @vmaid: VM area identifier.
@@ -549,48 +939,30 @@ int get_free_vmrg_area(struct pcb_t *caller,
     int  old_end  = cur_vma->vm_end;
 
 retry_search:
-    struct vm_rg_struct **best_prev = NULL;
-    struct vm_rg_struct  *best      = NULL;
-    int                   best_diff = INT32_MAX;
+    struct vm_rg_struct *best      = freerg_best_fit(cur_vma, size);
     int                   tail_free = 0;
 
-    struct vm_rg_struct **pp  = &cur_vma->vm_freerg_list;
-    struct vm_rg_struct  *cur = cur_vma->vm_freerg_list;
-    while (cur) {
-        int region_size = cur->rg_end - cur->rg_start;
-        int diff = region_size - size;
-
-        if (diff >= 0 && diff < best_diff) {
-            best_diff = diff;
-            best      = cur;
-            best_prev = pp;
-            if (diff == 0)
-                break; 
-        }
-
-        if (!expanded && cur->rg_end == old_end) {
-            tail_free = region_size;
-        }
-
-        pp  = &cur->rg_next;
-        cur =  cur->rg_next;
-    }
-
     if (best) {
         newrg->rg_start = best->rg_start;
         newrg->rg_end   = best->rg_start + size;
 
-        if (best_diff > 0) {
-            /* shrink front of the free region */
+        if (rg_size(best) > (unsigned long)size) {
+            /* shrink front of the free region, its address order holds */
+            rb_erase(&best->rg_size_node, &cur_vma->vm_freerg_size);
             best->rg_start += size;
+            rb_add(&best->rg_size_node, &cur_vma->vm_freerg_size, freerg_size_less);
         } else {
             /* exact fit: remove the node */
-            *best_prev = best->rg_next;
-            free(best);
+            freerg_remove(cur_vma, best);
         }
         return 0;
     }
 
+    /* A free region at the very end only needs topping up */
+    struct rb_node *last = rb_last(&cur_vma->vm_freerg_addr);
+    if (last && rg_of_addr(last)->rg_end == (unsigned long)old_end)
+        tail_free = rg_size(rg_of_addr(last));
+
     /* No best‐fit yet: expand once, then retry */
     if (!expanded) {
         int needed = size - tail_free;
@@ -600,12 +972,10 @@ retry_search:
         regs.a2 = vmaid;
         regs.a3 = needed;
 
-        if (__sys_memmap(caller, &regs) != 0) {
-          pthread_mutex_unlock(&mmvm_lock);
+        if (__sys_memmap(caller, &regs) != 0)
           return -1;
-        }
 
-        struct vm_rg_struct *added = malloc(sizeof(*added));
+        struct vm_rg_struct *added = kmem_cache_alloc(&vm_rg_cache);
         if (!added)
             return -1;
 
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 static uint32_t avail_pid = 1;
 
@@ -12,6 +13,10 @@ static uint32_t avail_pid = 1;
 #define OPT_READ	"read"
 #define OPT_WRITE	"write"
 #define OPT_SYSCALL	"syscall"
+#define OPT_READB	"readb"
+#define OPT_WRITEB	"writeb"
+#define OPT_COPYB	"copyb"
+#define OPT_FILLB	"fillb"
 
 static enum ins_opcode_t get_opcode(char * opt) {
 	if (!strcmp(opt, OPT_CALC)) {
@@ -26,6 +31,14 @@ static enum ins_opcode_t get_opcode(char * opt) {
 		return WRITE;
 	}else if (!strcmp(opt, OPT_SYSCALL)) {
 		return SYSCALL;
+	}else if (!strcmp(opt, OPT_READB)) {
+		return READB;
+	}else if (!strcmp(opt, OPT_WRITEB)) {
+		return WRITEB;
+	}else if (!strcmp(opt, OPT_COPYB)) {
+		return COPYB;
+	}else if (!strcmp(opt, OPT_FILLB)) {
+		return FILLB;
 	}else{
 		printf("get_opcode return Opcode: %s\n", opt);
 		exit(1);
@@ -60,6 +73,7 @@ struct pcb_t * load(const char * path) {
 	for (i = 0; i < proc->code->size; i++) {
 		fscanf(file, "%s", opcode);
 		proc->code->text[i].opcode = get_opcode(opcode);
+		proc->code->text[i].data = NULL;
 		switch(proc->code->text[i].opcode) {
 		case CALC:
 			break;
@@ -84,6 +98,53 @@ struct pcb_t * load(const char * path) {
 				&proc->code->text[i].arg_2
 			);
 			break;	
+		case READB:
+			fscanf(
+				file,
+				"%u %u %u\n",
+				&proc->code->text[i].arg_0,
+				&proc->code->text[i].arg_1,
+				&proc->code->text[i].arg_2
+			);
+			break;
+		case WRITEB:
+			/* The string is a single word, its length goes to arg_0.
+			 * One that does not fit in buf is an error, not cut short */
+			if (fscanf(file, "%199s", buf) != 1 || !isspace(fgetc(file))) {
+				printf("writeb operand longer than %zu bytes in '%s'\n",
+				       sizeof(buf) - 1, path);
+				exit(1);
+			}
+			fscanf(
+				file,
+				"%u %u\n",
+				&proc->code->text[i].arg_1,
+				&proc->code->text[i].arg_2
+			);
+			proc->code->text[i].data = strdup(buf);
+			proc->code->text[i].arg_0 = strlen(buf);
+			break;
+		case COPYB:
+			fscanf(
+				file,
+				"%u %u %u %u %u\n",
+				&proc->code->text[i].arg_0,
+				&proc->code->text[i].arg_1,
+				&proc->code->text[i].arg_2,
+				&proc->code->text[i].arg_3,
+				&proc->code->text[i].arg_4
+			);
+			break;
+		case FILLB:
+			fscanf(
+				file,
+				"%u %u %u %u\n",
+				&proc->code->text[i].arg_0,
+				&proc->code->text[i].arg_1,
+				&proc->code->text[i].arg_2,
+				&proc->code->text[i].arg_3
+			);
+			break;
 		case SYSCALL:
 			fgets(buf, sizeof(buf), file);
 			sscanf(buf, "%d%d%d%d",
@@ -103,3 +164,15 @@ struct pcb_t * load(const char * path) {
 
 
 
+
+/* Free what load() allocated, the memory of the process is already gone */
+void unload(struct pcb_t * proc) {
+	uint32_t i;
+
+	for (i = 0; i < proc->code->size; i++)
+		free(proc->code->text[i].data);
+	free(proc->code->text);
+	free(proc->code);
+	free(proc->page_table);
+	free(proc);
+}
@@ -0,0 +1,134 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Background page reclaim mm/mm-kswapd.c
+ *
+ * kswapd is a daemon device of the timer. At every time slot it checks
+ * the free RAM frames and, once they drop below the low watermark, swaps
+ * out pages of the registered processes round robin until the high
+ * watermark is reached. Faulting processes then mostly find a free frame
+ * instead of evicting on their own critical path.
+ *
+ * Lock order: mm_registry_lock, then mm_lock, then memphy locks.
+ */
+
+#include "mm.h"
+#include "timer.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static pthread_mutex_t mm_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pcb_t **mm_registry;
+static int mm_nr_registered;
+static int mm_registry_cap;
+static int kswapd_cursor;	/* next process to reclaim from */
+
+static unsigned long kswapd_nr_wakeups;
+static unsigned long kswapd_nr_reclaimed;
+
+/* Make the pages of @proc visible to kswapd, once its mm is set up */
+void mm_register(struct pcb_t *proc)
+{
+  pthread_mutex_lock(&mm_registry_lock);
+  if (mm_nr_registered == mm_registry_cap)
+  {
+    int newcap = mm_registry_cap ? 2 * mm_registry_cap : 8;
+    struct pcb_t **newreg = realloc(mm_registry, newcap * sizeof(*newreg));
+
+    if (newreg == NULL)
+    {
+      pthread_mutex_unlock(&mm_registry_lock);
+      return;
+    }
+    mm_registry = newreg;
+    mm_registry_cap = newcap;
+  }
+  mm_registry[mm_nr_registered++] = proc;
+  pthread_mutex_unlock(&mm_registry_lock);
+}
+
+/* Forget @proc, kswapd is not touching it once this returns */
+void mm_unregister(struct pcb_t *proc)
+{
+  int i;
+
+  pthread_mutex_lock(&mm_registry_lock);
+  for (i = 0; i < mm_nr_registered; i++)
+  {
+    if (mm_registry[i] == proc)
+    {
+      mm_registry[i] = mm_registry[--mm_nr_registered];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mm_registry_lock);
+}
+
+/*
+ * kswapd_balance - reclaim frames until @high of them are free
+ * @mram: RAM device
+ * @high: high watermark in frames
+ *
+ * Takes at most KSWAPD_BATCH pages from each process in turn, and stops
+ * early when a whole round frees nothing.
+ */
+static void kswapd_balance(struct memphy_struct *mram, int high)
+{
+  int nr_free, idle = 0;
+
+  pthread_mutex_lock(&mm_registry_lock);
+  while (mm_nr_registered > 0 && idle < mm_nr_registered &&
+         (nr_free = MEMPHY_nr_freefp(mram)) < high)
+  {
+    struct pcb_t *proc;
+    int want = high - nr_free, freed;
+
+    if (kswapd_cursor >= mm_nr_registered)
+      kswapd_cursor = 0;
+    proc = mm_registry[kswapd_cursor++];
+
+    pthread_mutex_lock(&proc->mm->mm_lock);
+    freed = reclaim_pages(proc, want < KSWAPD_BATCH ? want : KSWAPD_BATCH);
+    pthread_mutex_unlock(&proc->mm->mm_lock);
+
+    kswapd_nr_reclaimed += freed;
+    idle = freed ? 0 : idle + 1;
+  }
+  pthread_mutex_unlock(&mm_registry_lock);
+}
+
+void *kswapd_routine(void *args)
+{
+  struct kswapd_args *ka = (struct kswapd_args *)args;
+  int low = ka->mram->maxfp * KSWAPD_WMARK_LOW_PCT / 100;
+  int high = ka->mram->maxfp * KSWAPD_WMARK_HIGH_PCT / 100;
+
+  /* Tiny RAMs still keep a frame or two in reserve */
+  if (low < 1)
+    low = 1;
+  if (high <= low)
+    high = low + 1;
+
+  while (!timer_stopped())
+  {
+    if (MEMPHY_nr_freefp(ka->mram) < low)
+    {
+      kswapd_nr_wakeups++;
+      kswapd_balance(ka->mram, high);
+      /* Background write back, nobody waits for it */
+      MEMPHY_take_latency();
+    }
+    idle_slot(ka->timer_id, TIMER_NEVER);
+  }
+  detach_event(ka->timer_id);
+  return NULL;
+}
+
+void kswapd_report(void)
+{
+  printf("kswapd: %lu wakeups, %lu pages reclaimed\n",
+         kswapd_nr_wakeups, kswapd_nr_reclaimed);
+}
+
+// #endif
@@ -8,27 +8,78 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Device time not yet charged to the process running on this thread,
+ * in 1/MEMPHY_COST_SCALE slot units */
+#define MEMPHY_COST_SCALE 65536UL
+static __thread unsigned long memphy_cost_pending;
+
+/* Charge an access of @len bytes, a latency and a transfer time */
+static void memphy_charge(struct memphy_struct *mp, int len)
+{
+   if (mp->latency > 0)
+      memphy_cost_pending += mp->latency * MEMPHY_COST_SCALE;
+   if (mp->bandwidth > 0)
+      memphy_cost_pending += len * MEMPHY_COST_SCALE / mp->bandwidth;
+}
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
  *  @mp: memphy struct
  *  @offset: offset
+ *
+ *  The head goes straight to @offset, as on a tape. The distance is
+ *  added to the device statistics and to the latency owed by the
+ *  calling thread. Caller holds mp->lock.
  */
 int MEMPHY_mv_csr(struct memphy_struct *mp, int offset)
 {
-   int numstep = 0;
+   unsigned long dist;
 
-   mp->cursor = 0;
-   while (numstep < offset && numstep < mp->maxsz)
+   if (offset < 0 || offset > mp->maxsz)
+      return -1;
+
+   dist = (offset > mp->cursor) ? offset - mp->cursor : mp->cursor - offset;
+   mp->seek_dist += dist;
+   memphy_cost_pending += dist * MEMPHY_COST_SCALE / MEMPHY_SEEK_CELLS_PER_SLOT;
+   mp->cursor = offset;
+
+   return 0;
+}
+
+/* Seek a sequential device to @addr and pass the head over @len cells */
+static int memphy_seq_span(struct memphy_struct *mp, int addr, int len)
+{
+   pthread_mutex_lock(&mp->lock);
+   if (MEMPHY_mv_csr(mp, addr) != 0)
    {
-      /* Traverse sequentially */
-      mp->cursor = (mp->cursor + 1) % mp->maxsz;
-      numstep++;
+      pthread_mutex_unlock(&mp->lock);
+      return -1;
    }
+   mp->cursor += len;
+   pthread_mutex_unlock(&mp->lock);
 
    return 0;
 }
 
+/*
+ *  MEMPHY_take_latency - time slots owed by the calling thread
+ *
+ *  Returns the slots of the device accesses and seeks made since the
+ *  last call. Fractions of a slot add up until they make a whole one.
+ */
+int MEMPHY_take_latency(void)
+{
+   unsigned long slots = memphy_cost_pending / MEMPHY_COST_SCALE;
+
+   memphy_cost_pending %= MEMPHY_COST_SCALE;
+   return (int)slots;
+}
+
 /*
  *  MEMPHY_seq_read - read MEMPHY device
  *  @mp: memphy struct
@@ -40,11 +91,14 @@ int MEMPHY_seq_read(struct memphy_struct *mp, int addr, BYTE *value)
    if (mp == NULL)
       return -1;
 
-   if (!mp->rdmflg)
-      return -1; /* Not compatible mode for sequential read */
+   if (mp->rdmflg)
+      return -1; /* Random access device, use MEMPHY_read */
 
-   MEMPHY_mv_csr(mp, addr);
+   if (addr < 0 || addr >= mp->maxsz || memphy_seq_span(mp, addr, 1) != 0)
+      return -1;
    *value = (BYTE)mp->storage[addr];
+   __atomic_add_fetch(&mp->nr_read, 1, __ATOMIC_RELAXED);
+   memphy_charge(mp, 1);
 
    return 0;
 }
@@ -61,7 +115,11 @@ int MEMPHY_read(struct memphy_struct *mp, int addr, BYTE *value)
       return -1;
 
    if (mp->rdmflg)
+   {
       *value = mp->storage[addr];
+      __atomic_add_fetch(&mp->nr_read, 1, __ATOMIC_RELAXED);
+      memphy_charge(mp, 1);
+   }
    else /* Sequential access device */
       return MEMPHY_seq_read(mp, addr, value);
 
@@ -80,11 +138,14 @@ int MEMPHY_seq_write(struct memphy_struct *mp, int addr, BYTE value)
    if (mp == NULL)
       return -1;
 
-   if (!mp->rdmflg)
-      return -1; /* Not compatible mode for sequential read */
+   if (mp->rdmflg)
+      return -1; /* Random access device, use MEMPHY_write */
 
-   MEMPHY_mv_csr(mp, addr);
+   if (addr < 0 || addr >= mp->maxsz || memphy_seq_span(mp, addr, 1) != 0)
+      return -1;
    mp->storage[addr] = value;
+   __atomic_add_fetch(&mp->nr_written, 1, __ATOMIC_RELAXED);
+   memphy_charge(mp, 1);
 
    return 0;
 }
@@ -101,61 +162,248 @@ int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data)
       return -1;
 
    if (mp->rdmflg)
+   {
       mp->storage[addr] = data;
+      __atomic_add_fetch(&mp->nr_written, 1, __ATOMIC_RELAXED);
+      memphy_charge(mp, 1);
+   }
    else /* Sequential access device */
       return MEMPHY_seq_write(mp, addr, data);
 
    return 0;
 }
 
+/*
+ *  MEMPHY_copy_range - copy @len bytes between devices
+ *  @src: source memphy
+ *  @addrsrc: source address
+ *  @dst: destination memphy
+ *  @addrdst: destination address
+ *  @len: number of bytes
+ *
+ *  The whole block moves with one memmove, which also covers overlapping
+ *  ranges on the same device. A sequential device seeks once to the start
+ *  of the block and streams the rest.
+ */
+int MEMPHY_copy_range(struct memphy_struct *src, int addrsrc,
+                      struct memphy_struct *dst, int addrdst, int len)
+{
+   if (src == NULL || dst == NULL || len <= 0)
+      return -1;
+
+   if (addrsrc < 0 || addrsrc + len > src->maxsz ||
+       addrdst < 0 || addrdst + len > dst->maxsz)
+      return -1;
+
+   /* One head at a time, the memphy locks are never nested */
+   if (!src->rdmflg)
+      memphy_seq_span(src, addrsrc, len);
+   if (!dst->rdmflg)
+      memphy_seq_span(dst, addrdst, len);
+
+   memmove(dst->storage + addrdst, src->storage + addrsrc, len);
+   __atomic_add_fetch(&src->nr_read, len, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&dst->nr_written, len, __ATOMIC_RELAXED);
+   memphy_charge(src, len);
+   memphy_charge(dst, len);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_copy_frames - copy @nr contiguous frames between devices
+ *  @src: source memphy
+ *  @srcfpn: first source frame
+ *  @dst: destination memphy
+ *  @dstfpn: first destination frame
+ *  @nr: number of frames
+ */
+int MEMPHY_copy_frames(struct memphy_struct *src, int srcfpn,
+                       struct memphy_struct *dst, int dstfpn, int nr)
+{
+   return MEMPHY_copy_range(src, srcfpn * PAGING_PAGESZ,
+                            dst, dstfpn * PAGING_PAGESZ, nr * PAGING_PAGESZ);
+}
+
+/*
+ *  MEMPHY_read_range - read @len bytes of a device into @buf
+ *  @mp: memphy struct
+ *  @addr: first address
+ *  @buf: host buffer
+ *  @len: number of bytes
+ */
+int MEMPHY_read_range(struct memphy_struct *mp, int addr, BYTE *buf, int len)
+{
+   if (mp == NULL || len <= 0 || addr < 0 || addr + len > mp->maxsz)
+      return -1;
+
+   if (!mp->rdmflg)
+      memphy_seq_span(mp, addr, len);
+   memcpy(buf, mp->storage + addr, len);
+   __atomic_add_fetch(&mp->nr_read, len, __ATOMIC_RELAXED);
+   memphy_charge(mp, len);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_write_range - write @len bytes of @buf to a device
+ *  @mp: memphy struct
+ *  @addr: first address
+ *  @buf: host buffer
+ *  @len: number of bytes
+ */
+int MEMPHY_write_range(struct memphy_struct *mp, int addr, const BYTE *buf, int len)
+{
+   if (mp == NULL || len <= 0 || addr < 0 || addr + len > mp->maxsz)
+      return -1;
+
+   if (!mp->rdmflg)
+      memphy_seq_span(mp, addr, len);
+   memcpy(mp->storage + addr, buf, len);
+   __atomic_add_fetch(&mp->nr_written, len, __ATOMIC_RELAXED);
+   memphy_charge(mp, len);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_fill - set @len bytes of a device to @value
+ *  @mp: memphy struct
+ *  @addr: first address
+ *  @value: byte value
+ *  @len: number of bytes
+ */
+int MEMPHY_fill(struct memphy_struct *mp, int addr, BYTE value, int len)
+{
+   if (mp == NULL || len <= 0 || addr < 0 || addr + len > mp->maxsz)
+      return -1;
+
+   if (!mp->rdmflg)
+      memphy_seq_span(mp, addr, len);
+   memset(mp->storage + addr, value, len);
+   __atomic_add_fetch(&mp->nr_written, len, __ATOMIC_RELAXED);
+   memphy_charge(mp, len);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_zero_frame - clear a frame before handing it to a new page
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ */
+int MEMPHY_zero_frame(struct memphy_struct *mp, int fpn)
+{
+   return MEMPHY_fill(mp, fpn * PAGING_PAGESZ, 0, PAGING_PAGESZ);
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
+ *
+ *  Every frame starts free, so formatting is a single zeroed bitmap
+ *  allocation instead of one list node per frame.
  */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
    /* This setting come with fixed constant PAGESZ */
    int numfp = mp->maxsz / pagesz;
-   struct framephy_struct *newfst, *fst;
-   int iter = 0;
 
+   mp->fp_bitmap = NULL;
+   mp->fp_swpslot = NULL;
+   mp->maxfp = 0;
+   mp->nr_freefp = 0;
    if (numfp <= 0)
       return -1;
 
-   /* Init head of free framephy list */
-   fst = malloc(sizeof(struct framephy_struct));
-   fst->fpn = iter;
-   mp->free_fp_list = fst;
+   mp->fp_bitmap = calloc(DIV_ROUND_UP(numfp, BITS_PER_LONG),
+                          sizeof(unsigned long));
+   if (mp->fp_bitmap == NULL)
+      return -1;
+
+   mp->fp_swpslot = malloc(numfp * sizeof(int));
+   if (mp->fp_swpslot == NULL)
+      return -1;
+   memset(mp->fp_swpslot, 0xff, numfp * sizeof(int)); /* all -1 */
+
+   mp->maxfp = numfp;
+   mp->nr_freefp = numfp;
+   mp->fp_hint = 0;
+   mp->used_fp_list = NULL;
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_get_freefp - take the lowest free frame
+ *  @mp: memphy struct
+ *  @retfpn: obtained frame number
+ */
+int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
+{
+   int fpn;
 
-   /* We have list with first element, fill in the rest num-1 element member*/
-   for (iter = 1; iter < numfp; iter++)
+   pthread_mutex_lock(&mp->lock);
+   fpn = find_next_zero_bit(mp->fp_bitmap, mp->maxfp, mp->fp_hint);
+   if (mp->nr_freefp == 0 || fpn >= mp->maxfp)
    {
-      newfst = malloc(sizeof(struct framephy_struct));
-      newfst->fpn = iter;
-      newfst->fp_next = NULL;
-      fst->fp_next = newfst;
-      fst = newfst;
+      pthread_mutex_unlock(&mp->lock);
+      return -1;
    }
 
+   set_bit(fpn, mp->fp_bitmap);
+   mp->nr_freefp--;
+   mp->fp_hint = fpn + 1;
+   pthread_mutex_unlock(&mp->lock);
+   *retfpn = fpn;
+
    return 0;
 }
 
-int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
+/*
+ *  MEMPHY_get_freefp_range - take @nr physically contiguous frames
+ *  @mp: memphy struct
+ *  @nr: number of frames
+ *  @retfpn: first frame of the run
+ *
+ *  First fit over the bitmap, skipping whole words of used or free
+ *  frames at a time. Returns -1 if no run is long enough.
+ */
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nr, int *retfpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
+   int start, end, fpn;
 
-   if (fp == NULL)
+   if (nr <= 0)
       return -1;
 
-   *retfpn = fp->fpn;
-   mp->free_fp_list = fp->fp_next;
+   pthread_mutex_lock(&mp->lock);
+   if (mp->nr_freefp < nr)
+   {
+      pthread_mutex_unlock(&mp->lock);
+      return -1;
+   }
 
-   /* MEMPHY is iteratively used up until its exhausted
-    * No garbage collector acting then it not been released
-    */
-   free(fp);
+   start = find_next_zero_bit(mp->fp_bitmap, mp->maxfp, mp->fp_hint);
+   while (start + nr <= mp->maxfp)
+   {
+      end = find_next_bit(mp->fp_bitmap, start + nr, start);
+      if (end - start >= nr)
+      {
+         for (fpn = start; fpn < start + nr; fpn++)
+            set_bit(fpn, mp->fp_bitmap);
+         mp->nr_freefp -= nr;
+         if (start == mp->fp_hint)
+            mp->fp_hint = start + nr;
+         pthread_mutex_unlock(&mp->lock);
+         *retfpn = start;
+         return 0;
+      }
+      start = find_next_zero_bit(mp->fp_bitmap, mp->maxfp, end);
+   }
 
-   return 0;
+   pthread_mutex_unlock(&mp->lock);
+   return -1;
 }
 
 // int MEMPHY_dump(struct memphy_struct *mp)
@@ -194,34 +442,142 @@ int MEMPHY_dump(struct memphy_struct *mp)
 
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
-   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+   if (fpn < 0 || fpn >= mp->maxfp)
+      return -1;
 
-   /* Create new node with value fpn */
-   newnode->fpn = fpn;
-   newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
+   pthread_mutex_lock(&mp->lock);
+   if (!test_bit(fpn, mp->fp_bitmap))
+   {
+      pthread_mutex_unlock(&mp->lock);
+      return -1;
+   }
+
+   clear_bit(fpn, mp->fp_bitmap);
+   mp->fp_swpslot[fpn] = -1;
+   mp->nr_freefp++;
+   if (fpn < mp->fp_hint)
+      mp->fp_hint = fpn;
+   pthread_mutex_unlock(&mp->lock);
 
    return 0;
 }
 
+/* Number of free frames, a snapshot only as others may allocate meanwhile */
+int MEMPHY_nr_freefp(struct memphy_struct *mp)
+{
+   int nr;
+
+   pthread_mutex_lock(&mp->lock);
+   nr = mp->nr_freefp;
+   pthread_mutex_unlock(&mp->lock);
+
+   return nr;
+}
+
 /*
  *  Init MEMPHY struct
  */
-int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
+/*
+ *  memphy_map_storage - get the backing memory of a device
+ *  @max_size: device size in bytes
+ *  @path: file to map shared, or NULL for anonymous memory
+ *
+ *  Host pages are only allocated when first touched and read as zeroes
+ *  until then, so the cost follows the frames in use rather than the
+ *  configured size. A file keeps the device image after the run.
+ */
+static BYTE *memphy_map_storage(int max_size, const char *path)
 {
-   mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
+   void *storage;
+   int fd;
+
+   if (max_size <= 0)
+      return NULL;
+
+   if (path == NULL)
+      storage = mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   else
+   {
+      fd = open(path, O_RDWR | O_CREAT, 0600);
+      if (fd < 0)
+         return NULL;
+      if (ftruncate(fd, max_size) != 0)
+      {
+         close(fd);
+         return NULL;
+      }
+      storage = mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+      close(fd);
+   }
+
+   return (storage == MAP_FAILED) ? NULL : (BYTE *)storage;
+}
+
+/*
+ *  init_memphy_file - init a device stored in a file
+ *  @mp: memphy struct
+ *  @max_size: device size in bytes
+ *  @randomflg: random access device
+ *  @path: backing file, created if missing, or NULL for anonymous memory
+ */
+int init_memphy_file(struct memphy_struct *mp, int max_size, int randomflg,
+                     const char *path)
+{
+   mp->storage = memphy_map_storage(max_size, path);
+   if (mp->storage == NULL && max_size > 0)
+      return -1;
+
+   pthread_mutex_init(&mp->lock, NULL);
    mp->maxsz = max_size;
-   memset(mp->storage, 0, max_size * sizeof(BYTE));
 
    MEMPHY_format(mp, PAGING_PAGESZ);
 
    mp->rdmflg = (randomflg != 0) ? 1 : 0;
 
-   if (!mp->rdmflg) /* Not Ramdom acess device, then it serial device*/
-      mp->cursor = 0;
+   /* The head of a sequential device starts at the beginning */
+   mp->cursor = 0;
+   mp->nr_read = 0;
+   mp->nr_written = 0;
+   mp->seek_dist = 0;
+   mp->latency = 0;
+   mp->bandwidth = 0;
 
    return 0;
 }
 
+int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
+{
+   return init_memphy_file(mp, max_size, randomflg, NULL);
+}
+
+/*
+ *  MEMPHY_report - print the access statistics of a device
+ *  @name: device name
+ *  @mp: memphy struct
+ */
+void MEMPHY_report(const char *name, struct memphy_struct *mp)
+{
+   if (mp->maxsz <= 0)
+      return;
+   printf("%s: %lu bytes read, %lu bytes written, %lu cells seeked\n",
+          name, (unsigned long)mp->nr_read, (unsigned long)mp->nr_written,
+          mp->seek_dist);
+}
+
+/*
+ *  free_memphy - release a device, flushing it to its file if it has one
+ *  @mp: memphy struct
+ */
+void free_memphy(struct memphy_struct *mp)
+{
+   if (mp->storage != NULL)
+      munmap(mp->storage, mp->maxsz);
+   free(mp->fp_bitmap);
+   free(mp->fp_swpslot);
+   pthread_mutex_destroy(&mp->lock);
+   mp->storage = NULL;
+}
+
 // #endif
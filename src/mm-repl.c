@@ -0,0 +1,266 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Page replacement policies mm/mm-repl.c
+ *
+ * Resident pages of each mm are tracked in growable rings of page numbers,
+ * so mapping a page never allocates a list node. The policy is global and
+ * chosen once at startup with repl_set_policy().
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPL_RING_INIT_SZ 16
+
+/* 2Q queues: recent once-seen pages, frequent pages and ghost entries */
+#define REPL_A1IN 0
+#define REPL_AM   1
+#define REPL_A1OUT 2
+
+static void ring_push(struct pgn_ring *q, int pgn)
+{
+  if (q->size == q->capacity)
+  {
+    int newcap = q->capacity ? 2 * q->capacity : REPL_RING_INIT_SZ;
+    int *newpgn = malloc(newcap * sizeof(int));
+    int i;
+
+    /* Unwrap into the new buffer so head restarts at 0 */
+    for (i = 0; i < q->size; i++)
+      newpgn[i] = q->pgn[(q->head + i) % q->capacity];
+    free(q->pgn);
+    q->pgn = newpgn;
+    q->head = 0;
+    q->capacity = newcap;
+  }
+  q->pgn[(q->head + q->size) % q->capacity] = pgn;
+  q->size++;
+}
+
+static int ring_pop(struct pgn_ring *q)
+{
+  int pgn = q->pgn[q->head];
+
+  q->head = (q->head + 1) % q->capacity;
+  q->size--;
+  return pgn;
+}
+
+/* Resident pages only, entries of unmapped or swapped pages are dropped lazily */
+static int page_resident(struct mm_struct *mm, int pgn)
+{
+  uint32_t *ptep = pte_lookup(mm, pgn);
+
+  return ptep != NULL && PAGING_PAGE_PRESENT(*ptep) != 0;
+}
+
+/*
+ * FIFO: evict the page that was mapped the longest time ago
+ */
+static void fifo_page_mapped(struct mm_struct *mm, int pgn)
+{
+  ring_push(&mm->repl_q[0], pgn);
+}
+
+static int fifo_find_victim(struct mm_struct *mm, int *retpgn)
+{
+  struct pgn_ring *q = &mm->repl_q[0];
+
+  while (q->size > 0)
+  {
+    int pgn = ring_pop(q);
+    if (page_resident(mm, pgn))
+    {
+      *retpgn = pgn;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*
+ * CLOCK: FIFO order, but a page whose accessed bit is set gets a second
+ * chance. The hand clears the bit and moves the page to the tail.
+ */
+static int clock_sweep(struct mm_struct *mm, struct pgn_ring *q, int *retpgn)
+{
+  while (q->size > 0)
+  {
+    int pgn = ring_pop(q);
+    uint32_t *pte;
+
+    if (!page_resident(mm, pgn))
+      continue;
+
+    pte = pte_lookup(mm, pgn);
+
+    if (*pte & PAGING_PTE_ACCESSED_MASK)
+    {
+      CLRBIT(*pte, PAGING_PTE_ACCESSED_MASK);
+      ring_push(q, pgn);
+      continue;
+    }
+
+    *retpgn = pgn;
+    return 0;
+  }
+  return -1;
+}
+
+static int clock_find_victim(struct mm_struct *mm, int *retpgn)
+{
+  return clock_sweep(mm, &mm->repl_q[0], retpgn);
+}
+
+/*
+ * 2Q: pages enter A1in and leave it in FIFO order, only remembering their
+ * number in the A1out ghost queue. A page faulted back in while still a
+ * ghost has been reused and goes to Am, which is managed by CLOCK. One-off
+ * scans thus never push the working set out of Am.
+ *
+ * Ghost membership is a bitmap over page numbers. A page that is ghosted,
+ * revived and ghosted again before its first entry is trimmed may lose its
+ * ghost bit early, which only makes 2Q slightly more conservative.
+ */
+static void twoq_page_mapped(struct mm_struct *mm, int pgn)
+{
+  if (test_bit(pgn, mm->repl_ghost))
+  {
+    clear_bit(pgn, mm->repl_ghost);
+    ring_push(&mm->repl_q[REPL_AM], pgn);
+  }
+  else
+    ring_push(&mm->repl_q[REPL_A1IN], pgn);
+}
+
+static int twoq_find_victim(struct mm_struct *mm, int *retpgn)
+{
+  struct pgn_ring *a1in = &mm->repl_q[REPL_A1IN];
+  struct pgn_ring *am = &mm->repl_q[REPL_AM];
+  struct pgn_ring *a1out = &mm->repl_q[REPL_A1OUT];
+  int resident = a1in->size + am->size;
+  int kin = resident * REPL_2Q_KIN_PCT / 100;
+  int kout = resident * REPL_2Q_KOUT_PCT / 100;
+
+  if (a1in->size > kin || am->size == 0)
+  {
+    if (fifo_find_victim(mm, retpgn) == 0)
+    {
+      set_bit(*retpgn, mm->repl_ghost);
+      ring_push(a1out, *retpgn);
+      while (a1out->size > (kout > 0 ? kout : 1))
+        clear_bit(ring_pop(a1out), mm->repl_ghost);
+      return 0;
+    }
+  }
+
+  if (clock_sweep(mm, am, retpgn) == 0)
+    return 0;
+  return fifo_find_victim(mm, retpgn);
+}
+
+static struct repl_policy repl_policies[] = {
+  { .name = "fifo",  .page_mapped = fifo_page_mapped, .find_victim = fifo_find_victim },
+  { .name = "clock", .page_mapped = fifo_page_mapped, .find_victim = clock_find_victim },
+  { .name = "2q",    .page_mapped = twoq_page_mapped, .find_victim = twoq_find_victim },
+};
+
+#define REPL_NR_POLICIES (int)(sizeof(repl_policies) / sizeof(repl_policies[0]))
+
+static struct repl_policy *repl_policy = &repl_policies[REPL_DEFAULT_POLICY];
+
+/*
+ * repl_set_policy - select the page replacement policy by name
+ * @name: fifo, clock or 2q
+ *
+ * Must be called before any mm is initialized.
+ */
+int repl_set_policy(const char *name)
+{
+  int i;
+
+  for (i = 0; i < REPL_NR_POLICIES; i++)
+  {
+    if (strcmp(repl_policies[i].name, name) == 0)
+    {
+      repl_policy = &repl_policies[i];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+void repl_init_mm(struct mm_struct *mm)
+{
+  memset(mm->repl_q, 0, sizeof(mm->repl_q));
+  mm->repl_ghost = NULL;
+  if (repl_policy->page_mapped == twoq_page_mapped)
+    mm->repl_ghost = calloc(DIV_ROUND_UP(PAGING_MAX_PGN, BITS_PER_LONG),
+                            sizeof(unsigned long));
+}
+
+void repl_free_mm(struct mm_struct *mm)
+{
+  int i;
+
+  for (i = 0; i < REPL_NR_QUEUES; i++)
+    free(mm->repl_q[i].pgn);
+  free(mm->repl_ghost);
+  memset(mm->repl_q, 0, sizeof(mm->repl_q));
+  mm->repl_ghost = NULL;
+}
+
+/*
+ * repl_page_mapped - start tracking a page that just became resident
+ * @mm:  owner mm
+ * @pgn: page number
+ */
+void repl_page_mapped(struct mm_struct *mm, int pgn)
+{
+  CLRBIT(*pte_lookup(mm, pgn), PAGING_PTE_ACCESSED_MASK);
+  repl_policy->page_mapped(mm, pgn);
+}
+
+/* Count a page fault against the active policy */
+void repl_page_fault(void)
+{
+  __atomic_add_fetch(&repl_policy->nr_faults, 1, __ATOMIC_RELAXED);
+}
+
+/* Count pages actually copied out to swap */
+void repl_page_writeback(int nr)
+{
+  __atomic_add_fetch(&repl_policy->nr_writebacks, nr, __ATOMIC_RELAXED);
+}
+
+/*
+ * find_victim_page - pick a resident page to evict
+ * @mm:     owner mm
+ * @retpgn: selected victim page number
+ *
+ * The victim is no longer tracked by the policy. Returns 0 on success,
+ * or -1 if no page of @mm is resident.
+ */
+int find_victim_page(struct mm_struct *mm, int *retpgn)
+{
+  if (repl_policy->find_victim(mm, retpgn) != 0)
+    return -1;
+
+  /* The victim is about to be swapped out */
+  tlb_flush_mm(mm);
+  __atomic_add_fetch(&repl_policy->nr_evictions, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+void repl_report(void)
+{
+  printf("Page replacement (%s): %lu faults, %lu evictions, %lu writebacks\n",
+         repl_policy->name, (unsigned long)repl_policy->nr_faults,
+         (unsigned long)repl_policy->nr_evictions,
+         (unsigned long)repl_policy->nr_writebacks);
+}
+
+// #endif
@@ -0,0 +1,278 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Swap device layer mm/mm-swap.c
+ *
+ * Every configured swap device with a non-zero size is usable. A swap
+ * slot is named by a swap entry, the SWPTYP (device) and SWPOFF (frame)
+ * fields of a swapped PTE packed into one int, so the PTE alone tells
+ * where a page lives.
+ *
+ * Devices are tried in decreasing priority order. Devices of equal
+ * priority are used round robin, which stripes the swap traffic over
+ * them; a lower priority device is only used once all the higher ones
+ * are full.
+ *
+ * Under MM_ZSWAP, entries of type SWP_TYPE_ZSWAP name pages held in the
+ * compressed pool of mm-zswap.c rather than on a device.
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct swap_info {
+  struct memphy_struct *mp;
+  int prio;
+  unsigned long nr_writes;	/* pages written to the device */
+};
+
+static struct swap_info swap_info[PAGING_MAX_MMSWP]; /* indexed by SWPTYP */
+static int swap_order[PAGING_MAX_MMSWP];	/* usable types, highest prio first */
+static int nr_swap_order;
+static unsigned int swap_rotor;
+
+/*
+ * swap_init - register the swap devices
+ * @mswp: swap devices, indexed by swap type
+ * @nr:   number of devices
+ */
+void swap_init(struct memphy_struct **mswp, int nr)
+{
+  static const int prio[PAGING_MAX_MMSWP] = MM_SWAP_PRIO;
+  int i, j;
+
+  nr_swap_order = 0;
+  for (i = 0; i < nr && i < PAGING_MAX_MMSWP; i++)
+  {
+    swap_info[i].mp = mswp[i];
+    swap_info[i].prio = prio[i];
+    if (mswp[i]->maxfp == 0)
+      continue;
+
+    /* Insertion sort, equal priorities keep the device order */
+    for (j = nr_swap_order; j > 0 && swap_info[swap_order[j - 1]].prio < prio[i]; j--)
+      swap_order[j] = swap_order[j - 1];
+    swap_order[j] = i;
+    nr_swap_order++;
+  }
+}
+
+/* Device holding swap entry @ent, or NULL if it is not on a swap device */
+struct memphy_struct *swap_dev(int ent)
+{
+  if (ent < 0 || SWP_TYPE(ent) >= PAGING_MAX_MMSWP)
+    return NULL;
+  return swap_info[SWP_TYPE(ent)].mp;
+}
+
+/* Fill @types with the devices to try, in order. Each priority level
+ * starts at a different device on every call */
+static int swap_candidates(int *types)
+{
+  unsigned int rot = __atomic_fetch_add(&swap_rotor, 1, __ATOMIC_RELAXED);
+  int lo, hi, i;
+
+  for (lo = 0; lo < nr_swap_order; lo = hi)
+  {
+    for (hi = lo + 1; hi < nr_swap_order; hi++)
+      if (swap_info[swap_order[hi]].prio != swap_info[swap_order[lo]].prio)
+        break;
+    for (i = 0; i < hi - lo; i++)
+      types[lo + i] = swap_order[lo + (rot + i) % (hi - lo)];
+  }
+  return nr_swap_order;
+}
+
+/*
+ * swap_get_slot - allocate one swap slot
+ * @ent: returned swap entry
+ */
+int swap_get_slot(int *ent)
+{
+  int types[PAGING_MAX_MMSWP];
+  int i, n = swap_candidates(types), off;
+
+  for (i = 0; i < n; i++)
+  {
+    if (MEMPHY_get_freefp(swap_info[types[i]].mp, &off) == 0)
+    {
+      *ent = SWP_ENTRY(types[i], off);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*
+ * swap_get_slots - allocate @nr swap slots
+ * @nr:  number of slots
+ * @ent: returned swap entries
+ *
+ * A contiguous run on a single device is preferred so the batch can be
+ * written with few copies, otherwise the slots are spread over the
+ * devices one by one. Either all @nr slots are allocated or none.
+ */
+int swap_get_slots(int nr, int *ent)
+{
+  int types[PAGING_MAX_MMSWP];
+  int i, n = swap_candidates(types), off;
+
+  for (i = 0; i < n; i++)
+  {
+    if (MEMPHY_get_freefp_range(swap_info[types[i]].mp, nr, &off) == 0)
+    {
+      int k;
+
+      for (k = 0; k < nr; k++)
+        ent[k] = SWP_ENTRY(types[i], off + k);
+      return 0;
+    }
+  }
+
+  for (i = 0; i < nr; i++)
+  {
+    if (swap_get_slot(&ent[i]) != 0)
+    {
+      while (i-- > 0)
+        swap_put_slot(ent[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Release swap slot @ent */
+int swap_put_slot(int ent)
+{
+  struct memphy_struct *mp = swap_dev(ent);
+
+#ifdef MM_ZSWAP
+  if (ent >= 0 && SWP_TYPE(ent) == SWP_TYPE_ZSWAP)
+    return zswap_free(ent);
+#endif
+  if (mp == NULL)
+    return -1;
+  return MEMPHY_put_freefp(mp, SWP_OFFSET(ent));
+}
+
+/*
+ * swap_write_pages - write RAM frames out to swap
+ * @mram: RAM device
+ * @fpn:  frames to write
+ * @ent:  swap entry of each frame, -1 to get a new one
+ * @nr:   number of pages
+ *
+ * Under MM_ZSWAP a page goes to the compressed pool first, releasing its
+ * previous slot. The others are written to their swap device slot, the
+ * missing slots are allocated as one batch. Runs contiguous in RAM and
+ * on the same device are merged into a single copy.
+ *
+ * On failure every entry of @ent that is not -1 still holds an up to
+ * date copy of its frame.
+ */
+int swap_write_pages(struct memphy_struct *mram, const int *fpn,
+                     int *ent, int nr)
+{
+  int i, k, run, nr_new = 0, ret = 0;
+  int *newent;
+
+  for (i = 0; i < nr; i++)
+  {
+#ifdef MM_ZSWAP
+    int zent;
+
+    if (zswap_store(mram, fpn[i], &zent) == 0)
+    {
+      if (ent[i] >= 0)
+        swap_put_slot(ent[i]);
+      ent[i] = zent;
+      continue;
+    }
+#endif
+    /* A stale compressed copy cannot be rewritten in place */
+    if (ent[i] >= 0 && SWP_TYPE(ent[i]) == SWP_TYPE_ZSWAP)
+    {
+      swap_put_slot(ent[i]);
+      ent[i] = -1;
+    }
+    if (ent[i] < 0)
+      nr_new++;
+  }
+
+  if (nr_new > 0)
+  {
+    newent = malloc(nr_new * sizeof(int));
+    if (newent != NULL && swap_get_slots(nr_new, newent) == 0)
+    {
+      for (i = 0, k = 0; i < nr; i++)
+        if (ent[i] < 0)
+          ent[i] = newent[k++];
+    }
+    else
+      ret = -1;
+    free(newent);
+  }
+
+  i = 0;
+  while (i < nr)
+  {
+    struct memphy_struct *mp = swap_dev(ent[i]);
+
+    if (mp == NULL)
+    {
+      i++;
+      continue;
+    }
+    for (run = 1; i + run < nr; run++)
+      if (fpn[i + run] != fpn[i] + run || ent[i + run] != ent[i] + SWP_ENTRY(0, run))
+        break;
+
+    if (MEMPHY_copy_frames(mram, fpn[i], mp, SWP_OFFSET(ent[i]), run) != 0)
+    {
+      /* Those slots keep stale data, forget them */
+      for (k = i; k < i + run; k++)
+      {
+        swap_put_slot(ent[k]);
+        ent[k] = -1;
+      }
+      ret = -1;
+    }
+    else
+      __atomic_add_fetch(&swap_info[SWP_TYPE(ent[i])].nr_writes, run,
+                         __ATOMIC_RELAXED);
+    i += run;
+  }
+
+  return ret;
+}
+
+/* Copy the page in swap slot @ent into RAM frame @fpn */
+int swap_read_page(int ent, struct memphy_struct *mram, int fpn)
+{
+  struct memphy_struct *mp = swap_dev(ent);
+
+#ifdef MM_ZSWAP
+  if (ent >= 0 && SWP_TYPE(ent) == SWP_TYPE_ZSWAP)
+    return zswap_load(ent, mram, fpn);
+#endif
+  if (mp == NULL)
+    return -1;
+  return MEMPHY_copy_frames(mp, SWP_OFFSET(ent), mram, fpn, 1);
+}
+
+void swap_report(void)
+{
+  int i;
+
+  for (i = 0; i < nr_swap_order; i++)
+  {
+    struct swap_info *si = &swap_info[swap_order[i]];
+
+    printf("Swap %d (prio %d): %d/%d frames in use, %lu pages written\n",
+           swap_order[i], si->prio, si->mp->maxfp - MEMPHY_nr_freefp(si->mp),
+           si->mp->maxfp, (unsigned long)si->nr_writes);
+  }
+}
+
+// #endif
@@ -0,0 +1,84 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Software TLB mm/mm-tlb.c
+ *
+ * Each simulated CPU owns a direct mapped TLB caching (pid, pgn) -> fpn.
+ * Entries are tagged with the generation of their mm; bumping it with
+ * tlb_flush_mm() drops every cached translation of that mm at once, on
+ * whichever CPU they live.
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline struct tlb_entry *tlb_slot(struct tlb_struct *tlb,
+                                         uint32_t pid, int pgn)
+{
+  return &tlb->ent[(pgn ^ (pid * 0x9e37u)) & (TLB_NR_ENTRIES - 1)];
+}
+
+void tlb_init(struct tlb_struct *tlb)
+{
+  memset(tlb, 0, sizeof(*tlb));
+}
+
+/*
+ * tlb_lookup - translate a page through the TLB
+ * @tlb:    TLB of the running CPU
+ * @caller: process owning the page
+ * @pgn:    page number
+ * @fpn:    obtained frame number
+ *
+ * Returns the cached PTE pointer on a hit, or NULL on a miss.
+ */
+uint32_t *tlb_lookup(struct tlb_struct *tlb, struct pcb_t *caller, int pgn, int *fpn)
+{
+  struct tlb_entry *e = tlb_slot(tlb, caller->pid, pgn);
+
+  if (e->ptep != NULL && e->pid == caller->pid && e->pgn == pgn &&
+      e->gen == __atomic_load_n(&caller->mm->tlb_gen, __ATOMIC_ACQUIRE))
+  {
+    tlb->nr_hits++;
+    *fpn = e->fpn;
+    return e->ptep;
+  }
+
+  tlb->nr_misses++;
+  return NULL;
+}
+
+/* Cache a resident page, replacing whatever shared its slot */
+void tlb_insert(struct tlb_struct *tlb, struct pcb_t *caller, int pgn, int fpn)
+{
+  struct tlb_entry *e = tlb_slot(tlb, caller->pid, pgn);
+
+  e->pid = caller->pid;
+  e->pgn = pgn;
+  e->fpn = fpn;
+  e->gen = __atomic_load_n(&caller->mm->tlb_gen, __ATOMIC_ACQUIRE);
+  e->ptep = pte_lookup(caller->mm, pgn);
+}
+
+/* Invalidate all translations of @mm, caller holds mm->mm_lock */
+void tlb_flush_mm(struct mm_struct *mm)
+{
+  __atomic_add_fetch(&mm->tlb_gen, 1, __ATOMIC_RELEASE);
+}
+
+void tlb_report(struct tlb_struct *tlb, int nr_cpus)
+{
+  unsigned long hits = 0, misses = 0;
+  int i;
+
+  for (i = 0; i < nr_cpus; i++)
+  {
+    hits += tlb[i].nr_hits;
+    misses += tlb[i].nr_misses;
+  }
+  printf("TLB: %lu hits, %lu misses\n", hits, misses);
+}
+
+// #endif
@@ -33,6 +33,24 @@ struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid)
   return pvma;
 }
 
+/**
+ * find_vma - Find the VM area containing an address.
+ * @mm: Pointer to the memory management structure.
+ * @addr: Virtual address.
+ *
+ * Returns the VM area with vm_start <= addr < vm_end, or NULL if the
+ * address is not part of the address space.
+ */
+struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
+{
+  struct vm_area_struct *pvma;
+
+  for (pvma = mm->mmap; pvma != NULL; pvma = pvma->vm_next)
+    if (addr >= pvma->vm_start && addr < pvma->vm_end)
+      return pvma;
+  return NULL;
+}
+
 /**
  * get_vm_area_node_at_brk - Allocate a new VM region node at the current break.
  * @caller: Pointer to the calling process's control block.
@@ -48,7 +66,7 @@ struct vm_rg_struct *get_vm_area_node_at_brk(struct pcb_t *caller, int vmaid, in
   if (cur_vma == NULL)
     return NULL;
   
-  struct vm_rg_struct *newrg = malloc(sizeof(struct vm_rg_struct));
+  struct vm_rg_struct *newrg = kmem_cache_alloc(&vm_rg_cache);
   if (newrg == NULL)
     return NULL;
   
@@ -58,10 +76,11 @@ struct vm_rg_struct *get_vm_area_node_at_brk(struct pcb_t *caller, int vmaid, in
   return newrg;
 }
 
-int __mm_swap_page(struct pcb_t *caller, int vicfpn , int swpfpn)
+/* Write RAM frame @vicfpn out to swap entry @swpent, or to a new one
+ * if it is -1. @swpent is updated to where the page was written */
+int __mm_swap_page(struct pcb_t *caller, int vicfpn , int *swpent)
 {
-  __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
-  return 0;
+  return swap_write_pages(caller->mram, &vicfpn, swpent, 1);
 }
 
 /**
@@ -97,7 +116,7 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
  */
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
 {
-    struct vm_rg_struct *newrg = malloc(sizeof(struct vm_rg_struct));
+    struct vm_rg_struct *newrg = kmem_cache_alloc(&vm_rg_cache);
     if (!newrg)
       return -1;
     
@@ -105,34 +124,37 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
     int incnumpage = inc_amt / PAGING_PAGESZ;
     struct vm_rg_struct *area = get_vm_area_node_at_brk(caller, vmaid, inc_sz, inc_amt);
     if (area == NULL) {
-      free(newrg);
+      kmem_cache_free(&vm_rg_cache, newrg);
       return -1;
     }
     
     struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
     if (cur_vma == NULL) {
-      free(newrg);
-      free(area);
+      kmem_cache_free(&vm_rg_cache, newrg);
+      kmem_cache_free(&vm_rg_cache, area);
       return -1;
     }
     
     int old_end = cur_vma->vm_end;
     if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) < 0) {
-      free(newrg);
-      free(area);
+      kmem_cache_free(&vm_rg_cache, newrg);
+      kmem_cache_free(&vm_rg_cache, area);
       return -1;
     }
     
     cur_vma->vm_end = area->rg_end;
     cur_vma->sbrk  = area->rg_end;
     
-    if (vm_map_ram(caller, area->rg_start, area->rg_end, old_end, incnumpage, newrg) < 0) {
-      free(newrg);
-      free(area);
+    /* Without VM_POPULATE the new pages are faulted in on first touch */
+    if ((cur_vma->vm_flags & VM_POPULATE) &&
+        vm_map_ram(caller, area->rg_start, area->rg_end, old_end, incnumpage, newrg) < 0) {
+      kmem_cache_free(&vm_rg_cache, newrg);
+      kmem_cache_free(&vm_rg_cache, area);
       return -1;
     }
     
-    free(area);
+    kmem_cache_free(&vm_rg_cache, newrg);
+    kmem_cache_free(&vm_rg_cache, area);
     return 0;
 }
 // int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
@@ -0,0 +1,312 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Compressed swap pool mm/mm-zswap.c
+ *
+ * A few RAM frames are set aside at boot as a pool of small chunks.
+ * Evicted pages are compressed with a PackBits style run length coder
+ * and kept there, named by swap entries of type SWP_TYPE_ZSWAP. An all
+ * zero page only takes an entry, no pool space. Pages that compress
+ * badly, or do not fit anymore, go to the swap devices instead.
+ *
+ * zswap_lock is a leaf lock, like the memphy locks.
+ */
+
+#include "mm.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ZSWAP_CHUNKSZ 16
+#define ZSWAP_MAX_LEN (PAGING_PAGESZ * ZSWAP_MAX_PCT / 100)
+
+/* PackBits headers: 0..127 is a literal of h + 1 bytes, 128..255 repeats
+ * the next byte h - 125 times */
+#define ZSWAP_MAX_LITERAL 128
+#define ZSWAP_MIN_RUN 3
+#define ZSWAP_MAX_RUN 130
+
+struct zswap_entry {
+  int chunk;	/* first pool chunk, -1 for a zero page */
+  int len;	/* compressed bytes, -1 if the entry is free */
+};
+
+static pthread_mutex_t zswap_lock = PTHREAD_MUTEX_INITIALIZER;
+static BYTE *zswap_pool;	/* first byte of the frames taken from RAM */
+static unsigned long *zswap_chunk_map;
+static int zswap_nr_chunks;
+
+static struct zswap_entry *zswap_ent;
+static int zswap_nr_ent;
+static int zswap_cap_ent;
+static int *zswap_free_ids;	/* stack of free entries below zswap_nr_ent */
+static int zswap_nr_free_ids;
+
+static unsigned long zswap_nr_stored;
+static unsigned long zswap_nr_zero;
+static unsigned long zswap_nr_loads;
+static unsigned long zswap_nr_rejected;	/* did not compress well enough */
+static unsigned long zswap_nr_pool_full;
+static unsigned long zswap_bytes_in;	/* of the pages kept in the pool */
+static unsigned long zswap_bytes_out;
+
+/*
+ * zswap_init - carve the pool out of RAM
+ * @mram: RAM device
+ *
+ * Takes ZSWAP_POOL_PCT percent of the frames, in one contiguous run.
+ * With no frame to spare only zero pages are stored.
+ */
+void zswap_init(struct memphy_struct *mram)
+{
+  int nr_frames = mram->maxfp * ZSWAP_POOL_PCT / 100;
+  int fpn;
+
+  if (nr_frames == 0 || MEMPHY_get_freefp_range(mram, nr_frames, &fpn) != 0)
+    return;
+
+  zswap_pool = mram->storage + fpn * PAGING_PAGESZ;
+  zswap_nr_chunks = nr_frames * (PAGING_PAGESZ / ZSWAP_CHUNKSZ);
+  zswap_chunk_map = calloc(BITS_TO_LONGS(zswap_nr_chunks), sizeof(unsigned long));
+}
+
+/* First fit run of @nr free chunks. Caller holds zswap_lock */
+static int zswap_alloc_chunks(int nr)
+{
+  int start, end, i;
+
+  start = find_next_zero_bit(zswap_chunk_map, zswap_nr_chunks, 0);
+  while (start + nr <= zswap_nr_chunks)
+  {
+    end = find_next_bit(zswap_chunk_map, start + nr, start);
+    if (end - start >= nr)
+    {
+      for (i = start; i < start + nr; i++)
+        set_bit(i, zswap_chunk_map);
+      return start;
+    }
+    start = find_next_zero_bit(zswap_chunk_map, zswap_nr_chunks, end);
+  }
+  return -1;
+}
+
+static void zswap_free_chunks(int chunk, int len)
+{
+  int i;
+
+  for (i = 0; i < DIV_ROUND_UP(len, ZSWAP_CHUNKSZ); i++)
+    clear_bit(chunk + i, zswap_chunk_map);
+}
+
+/* Caller holds zswap_lock */
+static int zswap_alloc_id(void)
+{
+  if (zswap_nr_free_ids > 0)
+    return zswap_free_ids[--zswap_nr_free_ids];
+
+  if (zswap_nr_ent == zswap_cap_ent)
+  {
+    int newcap = zswap_cap_ent ? 2 * zswap_cap_ent : 64;
+    struct zswap_entry *newent;
+    int *newids;
+
+    if (newcap > SWP_OFFSET(PAGING_PTE_SWPOFF_MASK) + 1)
+      return -1;
+    newent = realloc(zswap_ent, newcap * sizeof(*newent));
+    if (newent == NULL)
+      return -1;
+    zswap_ent = newent;
+    newids = realloc(zswap_free_ids, newcap * sizeof(*newids));
+    if (newids == NULL)
+      return -1;
+    zswap_free_ids = newids;
+    zswap_cap_ent = newcap;
+  }
+  return zswap_nr_ent++;
+}
+
+static int zswap_page_is_zero(const BYTE *page)
+{
+  int i;
+
+  for (i = 0; i < PAGING_PAGESZ; i++)
+    if (page[i] != 0)
+      return 0;
+  return 1;
+}
+
+/* Compress a page into @dst, or return -1 past @max bytes */
+static int zswap_compress(const BYTE *src, BYTE *dst, int max)
+{
+  int i = 0, len = 0;
+
+  while (i < PAGING_PAGESZ)
+  {
+    int run = 1, lit = 0;
+
+    while (i + run < PAGING_PAGESZ && run < ZSWAP_MAX_RUN && src[i + run] == src[i])
+      run++;
+    if (run >= ZSWAP_MIN_RUN)
+    {
+      if (len + 2 > max)
+        return -1;
+      dst[len++] = (BYTE)(run + 125);
+      dst[len++] = src[i];
+      i += run;
+      continue;
+    }
+
+    /* Literal bytes up to the next run worth encoding */
+    while (i + lit < PAGING_PAGESZ && lit < ZSWAP_MAX_LITERAL &&
+           !(i + lit + 2 < PAGING_PAGESZ && src[i + lit] == src[i + lit + 1] &&
+             src[i + lit] == src[i + lit + 2]))
+      lit++;
+    if (len + 1 + lit > max)
+      return -1;
+    dst[len++] = (BYTE)(lit - 1);
+    memcpy(dst + len, src + i, lit);
+    len += lit;
+    i += lit;
+  }
+  return len;
+}
+
+static void zswap_decompress(const BYTE *src, int len, BYTE *dst)
+{
+  int i = 0;
+
+  while (i < len)
+  {
+    int h = (unsigned char)src[i++];
+
+    if (h >= ZSWAP_MAX_LITERAL)
+    {
+      memset(dst, src[i++], h - 125);
+      dst += h - 125;
+    }
+    else
+    {
+      memcpy(dst, src + i, h + 1);
+      dst += h + 1;
+      i += h + 1;
+    }
+  }
+}
+
+/*
+ * zswap_store - keep a compressed copy of a RAM frame
+ * @mram: RAM device
+ * @fpn:  frame to store
+ * @ent:  returned swap entry
+ *
+ * Returns -1 if the page should go to a swap device instead.
+ */
+int zswap_store(struct memphy_struct *mram, int fpn, int *ent)
+{
+  const BYTE *page = mram->storage + fpn * PAGING_PAGESZ;
+  BYTE buf[ZSWAP_MAX_LEN];
+  int len = 0, chunk = -1, id;
+
+  if (!zswap_page_is_zero(page))
+  {
+    len = zswap_compress(page, buf, ZSWAP_MAX_LEN);
+    if (len < 0)
+    {
+      pthread_mutex_lock(&zswap_lock);
+      zswap_nr_rejected++;
+      pthread_mutex_unlock(&zswap_lock);
+      return -1;
+    }
+  }
+
+  pthread_mutex_lock(&zswap_lock);
+  if (len > 0)
+  {
+    chunk = zswap_alloc_chunks(DIV_ROUND_UP(len, ZSWAP_CHUNKSZ));
+    if (chunk < 0)
+    {
+      zswap_nr_pool_full++;
+      pthread_mutex_unlock(&zswap_lock);
+      return -1;
+    }
+  }
+
+  id = zswap_alloc_id();
+  if (id < 0)
+  {
+    if (chunk >= 0)
+      zswap_free_chunks(chunk, len);
+    pthread_mutex_unlock(&zswap_lock);
+    return -1;
+  }
+
+  if (chunk >= 0)
+  {
+    memcpy(zswap_pool + chunk * ZSWAP_CHUNKSZ, buf, len);
+    zswap_bytes_in += PAGING_PAGESZ;
+    zswap_bytes_out += len;
+  }
+  else
+    zswap_nr_zero++;
+  zswap_ent[id].chunk = chunk;
+  zswap_ent[id].len = len;
+  zswap_nr_stored++;
+  pthread_mutex_unlock(&zswap_lock);
+
+  *ent = SWP_ENTRY(SWP_TYPE_ZSWAP, id);
+  return 0;
+}
+
+/* Decompress entry @ent into RAM frame @fpn, the entry stays valid */
+int zswap_load(int ent, struct memphy_struct *mram, int fpn)
+{
+  BYTE *page = mram->storage + fpn * PAGING_PAGESZ;
+  int id = SWP_OFFSET(ent);
+
+  pthread_mutex_lock(&zswap_lock);
+  if (id >= zswap_nr_ent || zswap_ent[id].len < 0)
+  {
+    pthread_mutex_unlock(&zswap_lock);
+    return -1;
+  }
+
+  if (zswap_ent[id].chunk < 0)
+    memset(page, 0, PAGING_PAGESZ);
+  else
+    zswap_decompress(zswap_pool + zswap_ent[id].chunk * ZSWAP_CHUNKSZ,
+                     zswap_ent[id].len, page);
+  zswap_nr_loads++;
+  pthread_mutex_unlock(&zswap_lock);
+  return 0;
+}
+
+int zswap_free(int ent)
+{
+  int id = SWP_OFFSET(ent);
+
+  pthread_mutex_lock(&zswap_lock);
+  if (id >= zswap_nr_ent || zswap_ent[id].len < 0)
+  {
+    pthread_mutex_unlock(&zswap_lock);
+    return -1;
+  }
+
+  if (zswap_ent[id].chunk >= 0)
+    zswap_free_chunks(zswap_ent[id].chunk, zswap_ent[id].len);
+  zswap_ent[id].len = -1;
+  zswap_free_ids[zswap_nr_free_ids++] = id;
+  pthread_mutex_unlock(&zswap_lock);
+  return 0;
+}
+
+void zswap_report(void)
+{
+  printf("zswap: %lu stores (%lu zero pages), %lu loads, %lu rejected, %lu pool full, "
+         "compression ratio %.2f\n",
+         zswap_nr_stored, zswap_nr_zero, zswap_nr_loads, zswap_nr_rejected,
+         zswap_nr_pool_full,
+         zswap_bytes_out ? (double)zswap_bytes_in / zswap_bytes_out : 0.0);
+}
+
+// #endif
@@ -5,8 +5,14 @@
  */
 
 #include "mm.h"
+#include "libmem.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+KMEM_CACHE(vm_rg_cache, struct vm_rg_struct);
+KMEM_CACHE(framephy_cache, struct framephy_struct);
+KMEM_CACHE(pgn_cache, struct pgn_t);
 
 /*
  * init_pte - Initialize PTE entry
@@ -104,8 +110,11 @@ int vmap_page_range(struct pcb_t *caller,           // process call
   struct framephy_struct *fpit = frames;
   for (pgit = 0; pgit < pgnum && fpit != NULL; pgit++) {
     int cur_pgn = pgn + pgit;
-    pte_set_fpn(&caller->mm->pgd[cur_pgn], fpit->fpn);
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn + pgit);
+    uint32_t *ptep = pte_alloc(caller->mm, cur_pgn);
+    if (ptep == NULL)
+      break;
+    pte_set_fpn(ptep, fpit->fpn);
+    repl_page_mapped(caller->mm, pgn + pgit);
     fpit = fpit->fp_next;
   }
   /* Tracking for later page replacement activities (if needed)
@@ -115,6 +124,101 @@ int vmap_page_range(struct pcb_t *caller,           // process call
   return 0;
 }
 
+/*
+ * swap_out_victims - free @nr RAM frames by swapping out victim pages
+ * @caller : caller
+ * @vicfpn : returned freed frames
+ * @nr     : number of frames needed
+ *
+ * A clean victim whose frame still has its swap copy is simply dropped.
+ * The others are written back as one batch by swap_write_pages().
+ */
+static int swap_out_victims(struct pcb_t *caller, int *vicfpn, int nr)
+{
+  struct mm_struct *mm = caller->mm;
+  int *buf = malloc(5 * nr * sizeof(int));
+  int *vicpgn = buf, *swpent = buf + nr;
+  int *cpsrc = buf + 2 * nr, *cpent = buf + 3 * nr, *cpidx = buf + 4 * nr;
+  int i, k, nr_vic = 0, nr_cp = 0, ret = -1;
+
+  if (buf == NULL)
+    return -1;
+
+  for (nr_vic = 0; nr_vic < nr; nr_vic++) {
+    if (find_victim_page(mm, &vicpgn[nr_vic]) < 0)
+      goto out_put;
+    vicfpn[nr_vic] = PAGING_PTE_FPN(*pte_lookup(mm, vicpgn[nr_vic]));
+    swpent[nr_vic] = caller->mram->fp_swpslot[vicfpn[nr_vic]];
+
+    /* Only pages never written out or modified since need a copy */
+    if (swpent[nr_vic] < 0 || (*pte_lookup(mm, vicpgn[nr_vic]) & PAGING_PTE_DIRTY_MASK)) {
+      cpsrc[nr_cp] = vicfpn[nr_vic];
+      cpent[nr_cp] = swpent[nr_vic];
+      cpidx[nr_cp] = nr_vic;
+      nr_cp++;
+    }
+  }
+
+  if (swap_write_pages(caller->mram, cpsrc, cpent, nr_cp) != 0) {
+    /* The victims stay mapped, a copy that did get written makes its
+     * page clean */
+    for (k = 0; k < nr_cp; k++) {
+      caller->mram->fp_swpslot[cpsrc[k]] = cpent[k];
+      if (cpent[k] >= 0)
+        CLRBIT(*pte_lookup(mm, vicpgn[cpidx[k]]), PAGING_PTE_DIRTY_MASK);
+    }
+    goto out_put;
+  }
+  for (k = 0; k < nr_cp; k++)
+    swpent[cpidx[k]] = cpent[k];
+
+  for (i = 0; i < nr; i++) {
+    uint32_t *vicpte = pte_lookup(mm, vicpgn[i]);
+    CLRBIT(*vicpte, PAGING_PTE_DIRTY_MASK);
+    pte_set_swap(vicpte, SWP_TYPE(swpent[i]), SWP_OFFSET(swpent[i]));
+    caller->mram->fp_swpslot[vicfpn[i]] = -1;
+  }
+  repl_page_writeback(nr_cp);
+  ret = 0;
+  goto out;
+
+out_put:
+  /* Undo partial progress, the victims taken so far are still mapped */
+  while (nr_vic-- > 0)
+    repl_page_mapped(mm, vicpgn[nr_vic]);
+out:
+  free(buf);
+  return ret;
+}
+
+/*
+ * reclaim_pages - swap out up to @nr resident pages and free their frames
+ * @caller : owner of the pages, caller holds caller->mm->mm_lock
+ * @nr     : number of frames wanted
+ *
+ * Returns the number of frames given back to RAM.
+ */
+int reclaim_pages(struct pcb_t *caller, int nr)
+{
+  int *vicfpn = malloc(nr * sizeof(int));
+  int i, freed = 0;
+
+  if (vicfpn == NULL)
+    return 0;
+
+  /* One batch when enough pages are resident, page by page otherwise */
+  if (swap_out_victims(caller, vicfpn, nr) == 0)
+    freed = nr;
+  else
+    while (freed < nr && swap_out_victims(caller, &vicfpn[freed], 1) == 0)
+      freed++;
+
+  for (i = 0; i < freed; i++)
+    MEMPHY_put_freefp(caller->mram, vicfpn[i]);
+  free(vicfpn);
+  return freed;
+}
+
 /*
  * alloc_pages_range - allocate req_pgnum of frame in ram
  * @caller    : caller
@@ -123,51 +227,49 @@ int vmap_page_range(struct pcb_t *caller,           // process call
  */
 
  int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst) {
-  int pgit, fpn;
+  int pgit, fpn, runfpn;
   struct framephy_struct *newfp_str = NULL;
+  struct framephy_struct **tail = &newfp_str;
+  int *vicfpn = NULL;
 
   if ((caller->mram->maxsz / PAGING_PAGESZ) < req_pgnum) return -3000;
 
+  /* Prefer one contiguous run, fall back to single frames otherwise */
+  if (MEMPHY_get_freefp_range(caller->mram, req_pgnum, &runfpn) < 0)
+    runfpn = -1;
+
   for (pgit = 0; pgit < req_pgnum; pgit++) {
-    if (MEMPHY_get_freefp(caller->mram, &fpn) == 0) {
-      struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
-      newnode->fpn = fpn;
-      newnode->owner = caller->mm;
-      newnode->fp_next = NULL;
-
-      if (newfp_str == NULL) {
-        newfp_str = newnode;
-      } else {
-        struct framephy_struct *temp = newfp_str;
-        while (temp->fp_next != NULL) temp = temp->fp_next;
-        temp->fp_next = newnode;
-      }
-    } else {
-      int swpfpn;
-      uint32_t *vicpte;
-      int vicpgn;
-
-      if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) < 0) return -3000;
-      if (find_victim_page(caller->mm, &vicpgn) < 0) return -3000;
-      vicpte = &caller->mm->pgd[vicpgn];
-      int vicfpn = GETVAL(*vicpte, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
-      __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
-      pte_set_swap(vicpte, 0, swpfpn);
-
-      struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
-      newnode->fpn = vicfpn;
-      newnode->owner = caller->mm;
-      newnode->fp_next = NULL;
-
-      if (newfp_str == NULL) {
-        newfp_str = newnode;
-      } else {
-        struct framephy_struct *temp = newfp_str;
-        while (temp->fp_next != NULL) temp = temp->fp_next;
-        temp->fp_next = newnode;
+    struct framephy_struct *newnode;
+
+    if (runfpn >= 0) {
+      fpn = runfpn + pgit;
+    } else if (vicfpn != NULL) {
+      fpn = vicfpn[pgit];
+    } else if (MEMPHY_get_freefp(caller->mram, &fpn) != 0) {
+      /* RAM is full: evict every remaining page in one batch */
+      vicfpn = malloc(req_pgnum * sizeof(int));
+      if (swap_out_victims(caller, vicfpn + pgit, req_pgnum - pgit) != 0) {
+        free(vicfpn);
+        /* Give back the frames taken so far */
+        while (newfp_str != NULL) {
+          newnode = newfp_str;
+          newfp_str = newnode->fp_next;
+          MEMPHY_put_freefp(caller->mram, newnode->fpn);
+          kmem_cache_free(&framephy_cache, newnode);
+        }
+        return -3000;
       }
+      fpn = vicfpn[pgit];
     }
+
+    newnode = kmem_cache_alloc(&framephy_cache);
+    newnode->fpn = fpn;
+    newnode->owner = caller->mm;
+    newnode->fp_next = NULL;
+    *tail = newnode;
+    tail = &newnode->fp_next;
   }
+  free(vicfpn);
   *frm_lst = newfp_str;
   return 0;
 }
@@ -210,6 +312,12 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
    * do the swaping all to swapper to get the all in ram */
   vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
 
+  while (frm_lst != NULL) {
+    struct framephy_struct *fp = frm_lst;
+    frm_lst = fp->fp_next;
+    kmem_cache_free(&framephy_cache, fp);
+  }
+
   return 0;
 }
 
@@ -222,19 +330,74 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                    struct memphy_struct *mpdst, int dstfpn)
 {
-  int cellidx;
-  int addrsrc, addrdst;
-  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
+  return MEMPHY_copy_frames(mpsrc, srcfpn, mpdst, dstfpn, 1);
+}
 
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
+struct pte_table {
+  uint32_t pte[1 << PAGING_PTE_SHIFT];
+};
+
+static KMEM_CACHE(pte_table_cache, struct pte_table);
+
+/*
+ * pte_alloc - find the PTE of a page, allocating its leaf table if needed
+ * @mm:  owner mm
+ * @pgn: page number
+ *
+ * Returns NULL only if the leaf table could not be allocated.
+ */
+uint32_t *pte_alloc(struct mm_struct *mm, int pgn)
+{
+  uint32_t **leaf = &mm->pgd[PAGING_PGD_IDX(pgn)];
+
+  if (*leaf == NULL) {
+    struct pte_table *tbl = kmem_cache_alloc(&pte_table_cache);
+    if (tbl == NULL)
+      return NULL;
+    memset(tbl, 0, sizeof(*tbl));
+    *leaf = tbl->pte;
   }
+  return &(*leaf)[PAGING_PTE_IDX(pgn)];
+}
 
-  return 0;
+/*
+ * pte_next_mapped - find the next page in use
+ * @mm:   owner mm
+ * @pgn:  first page number to look at
+ * @ptep: returned PTE
+ *
+ * Returns the page number of the first non-empty PTE from @pgn on, or -1.
+ * Leaf tables never allocated are skipped whole.
+ */
+int pte_next_mapped(struct mm_struct *mm, int pgn, uint32_t **ptep)
+{
+  int idx;
+
+  for (idx = PAGING_PGD_IDX(pgn); idx < PAGING_PGD_ENTRIES; idx++) {
+    uint32_t *leaf = mm->pgd[idx];
+    int i = (idx == PAGING_PGD_IDX(pgn)) ? PAGING_PTE_IDX(pgn) : 0;
+
+    if (leaf == NULL)
+      continue;
+    for (; i < (1 << PAGING_PTE_SHIFT); i++) {
+      if (leaf[i] != 0) {
+        *ptep = &leaf[i];
+        return (idx << PAGING_PTE_SHIFT) + i;
+      }
+    }
+  }
+  return -1;
+}
+
+/* Release the leaf tables of @mm, its pages must have been freed already */
+void free_pgd(struct mm_struct *mm)
+{
+  int idx;
+
+  for (idx = 0; idx < PAGING_PGD_ENTRIES; idx++) {
+    kmem_cache_free(&pte_table_cache, mm->pgd[idx]);
+    mm->pgd[idx] = NULL;
+  }
 }
 
 /*
@@ -247,23 +410,21 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
   if (vma0 == NULL)
     return -1;
-  mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
-  if (mm->pgd == NULL) {
-    free(vma0);
-    return -1;
-  }
+  /* Every page starts unmapped, leaf tables come with the first use */
+  memset(mm->pgd, 0, sizeof(mm->pgd));
   /* By default the owner comes with at least one vma */
   vma0->vm_id = 0;
   vma0->vm_start = 0;
   vma0->vm_end = 0;
   vma0->sbrk = 0;
-  struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
-  if (first_rg == NULL) {
-    free(vma0);
-    free(mm->pgd);
-    return -1;
-  }
-  enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
+#ifdef MM_POPULATE
+  vma0->vm_flags = VM_POPULATE;
+#else
+  vma0->vm_flags = 0;
+#endif
+  /* The area is still empty, so is its free region index */
+  vma0->vm_freerg_addr = RB_ROOT;
+  vma0->vm_freerg_size = RB_ROOT;
 
   /* TODO update VMA0 next */
   vma0->vm_next = NULL;
@@ -273,12 +434,57 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   /* TODO: update mmap */
   mm->mmap = vma0;
 
+  pthread_mutex_init(&mm->mm_lock, NULL);
+
+  repl_init_mm(mm);
+
   return 0;
 }
 
+/* Free a free-region tree bottom up, no rebalancing needed as it all goes */
+static void free_rg_tree(struct rb_node *node)
+{
+  if (node == NULL)
+    return;
+  free_rg_tree(node->left);
+  free_rg_tree(node->right);
+  kmem_cache_free(&vm_rg_cache, rb_entry(node, struct vm_rg_struct, rg_addr_node));
+}
+
+/*
+ * exit_mm - release the whole mm of an exiting process
+ * @caller: mm owner, no longer scheduled nor visible to kswapd
+ *
+ * Returns the frames and swap slots of the pages in use, then the page
+ * table, the replacement state, the areas and their free regions. The
+ * cost follows the mapped pages, not the size of the address space.
+ */
+void exit_mm(struct pcb_t *caller)
+{
+  struct mm_struct *mm = caller->mm;
+  struct vm_area_struct *vma, *next;
+
+  if (mm == NULL)
+    return;
+
+  free_pcb_memph(caller);
+  free_pgd(mm);
+  repl_free_mm(mm);
+
+  for (vma = mm->mmap; vma != NULL; vma = next) {
+    next = vma->vm_next;
+    free_rg_tree(vma->vm_freerg_addr.rb_node);
+    free(vma);
+  }
+
+  pthread_mutex_destroy(&mm->mm_lock);
+  free(mm);
+  caller->mm = NULL;
+}
+
 struct vm_rg_struct *init_vm_rg(int rg_start, int rg_end)
 {
-  struct vm_rg_struct *rgnode = malloc(sizeof(struct vm_rg_struct));
+  struct vm_rg_struct *rgnode = kmem_cache_alloc(&vm_rg_cache);
 
   rgnode->rg_start = rg_start;
   rgnode->rg_end = rg_end;
@@ -297,7 +503,7 @@ int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct *rgnode)
 
 int enlist_pgn_node(struct pgn_t **plist, int pgn)
 {
-  struct pgn_t *pnode = malloc(sizeof(struct pgn_t));
+  struct pgn_t *pnode = kmem_cache_alloc(&pgn_cache);
 
   pnode->pgn = pgn;
   pnode->pg_next = *plist;
@@ -408,12 +614,14 @@ int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
     printf("print_pgtbl: %d - %d\n", start, end);
     for (int pgit = pgn_start; pgit < pgn_end; pgit++)
     {
-      printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
+      uint32_t *ptep = pte_lookup(caller->mm, pgit);
+      printf("%08ld: %08x\n", pgit * sizeof(uint32_t), ptep ? *ptep : 0);
     }
-    for (int pgit = pgn_start; pgit < pgn_end; pgit++) {
-        uint32_t pte = caller->mm->pgd[pgit];
-        if (PAGING_PAGE_PRESENT(pte)) {
-            int frame = PAGING_FPN(pte);
+    uint32_t *ptep;
+    int pgit = pte_next_mapped(caller->mm, pgn_start, &ptep);
+    for (; pgit >= 0 && pgit < pgn_end; pgit = pte_next_mapped(caller->mm, pgit + 1, &ptep)) {
+        if (PAGING_PAGE_PRESENT(*ptep)) {
+            int frame = PAGING_FPN(*ptep);
             printf("Page Number: %d -> Frame Number: %d\n", pgit, frame);
         }
     }
@@ -16,6 +16,7 @@ static int done = 0;
 #ifdef MM_PAGING
 static int memramsz;
 static int memswpsz[PAGING_MAX_MMSWP];
+static struct tlb_struct *cpu_tlb; /* one per simulated CPU */
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -37,150 +38,277 @@ static struct ld_args{
 } ld_processes;
 int num_processes;
 
+/* State of one simulated CPU, stepped one instruction per time slot */
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
+	struct pcb_t * proc;	/* process currently on the CPU */
+#ifdef MLQ_SCHED
+	int time_left;
+#elif CFS_SCHED
+	uint64_t elapsed_ns;
+	uint64_t current_timeslice;
+#endif
 };
 
+#ifdef SIM_EVENT_ENGINE
+/* A worker thread drives a contiguous range of simulated CPUs */
+struct worker_args {
+	struct timer_id_t * timer_id;
+	struct cpu_args * cpus;
+	int nr_cpus;
+};
+#endif
 
-static void * cpu_routine(void * args) {
-	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
-	int id = ((struct cpu_args*)args)->id;
-	struct pcb_t * proc = NULL;
-	/* Check for new process in ready queue */
+enum cpu_state_t {
+	CPU_BUSY,	/* ran an instruction, needs the next slot */
+	CPU_IDLE,	/* nothing to run until a process is added or woken */
+	CPU_STOPPED,	/* no process left and the loader is done */
+};
+
+#if defined(CFS_SCHED) && !defined(MLQ_SCHED)
+/* Pick the next process of this CPU's runqueue and compute its slice */
+static void cfs_dispatch(struct cpu_args * cpu) {
+	cpu->proc = cfs_pick_next(cpu->id);
+	if (cpu->proc == NULL)
+		return;
+
+	/* Calculate process time slice - include current process weight since it's been dequeued */
+	cpu->current_timeslice = cfs_timeslice(cpu->id, cpu->proc,
+		cpu->proc->cfs_ent.weight) / 1000000; // Convert ns to time slots
+	if (cpu->current_timeslice < 1) cpu->current_timeslice = 1;
+
+	cpu->elapsed_ns = 0;
+	printf("\tCPU %d: Dispatched process %2d (timeslice: %lu)\n",
+		cpu->id, cpu->proc->pid, cpu->current_timeslice);
+}
+#endif
+
+/* Release a finished process along with every frame and swap slot it holds */
+static void exit_proc(struct pcb_t * proc) {
+	remove_proc(proc);
+#ifdef MM_PAGING
+#ifdef MM_KSWAPD
+	mm_unregister(proc);
+#endif
+	exit_mm(proc);
+#endif
+	unload(proc);
+}
+
+#ifdef MM_PAGING
+/* If the last instruction waited on a device, block the process for as
+ * many slots and leave the CPU to somebody else. Returns 1 if it did */
+static int device_wait(struct cpu_args * cpu) {
+	int lat = MEMPHY_take_latency();
+
+	if (lat == 0)
+		return 0;
+	printf("\tCPU %d: Process %2d blocked on a device for %d slots\n",
+		cpu->id, cpu->proc->pid, lat);
 #ifdef MLQ_SCHED
-	int time_left = 0;
-	while (1) {
-		/* Check the status of current process */
-		if (proc == NULL) {
-			/* No process is running, the we load new process from
-		 	* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           continue; /* First load failed. skip dummy load */
-                        }
-		}else if (proc->pc == proc->code->size) {
-			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
-			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
-		}
+	cpu->time_left = 0;
+#else
+	/* Charge the slot that just ran too */
+	cfs_update_vruntime(cpu->proc, (cpu->elapsed_ns + 1) * 1000000);
+#endif
+	block_proc(cpu->proc, current_time() + lat + 1);
+	cpu->proc = NULL;
+	return 1;
+}
+#endif
 
-		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
-			break;
-		}else if (proc == NULL) {
-			/* There may be new processes to run in
-			 * next time slots, just skip current slot */
-			next_slot(timer_id);
-			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			time_left = time_slot;
-		}
+/*
+ * cpu_step - run one time slot of a simulated CPU.
+ *
+ * Handles finished processes and expired time slices, dispatches the
+ * next process and executes one of its instructions. The caller then
+ * waits for the next slot (CPU_BUSY), sleeps until work shows up
+ * (CPU_IDLE) or retires the CPU (CPU_STOPPED).
+ */
+static enum cpu_state_t cpu_step(struct cpu_args * cpu) {
+	int id = cpu->id;
+
+	wake_procs(current_time());
+#ifdef MLQ_SCHED
+	/* Check the status of current process */
+	if (cpu->proc == NULL) {
+		/* No process is running, the we load new process from
+		 * ready queue */
+		cpu->proc = get_proc();
+	}else if (cpu->proc->pc == cpu->proc->code->size) {
+		/* The porcess has finish it job */
+		printf("\tCPU %d: Processed %2d has finished\n",
+			id ,cpu->proc->pid);
+		exit_proc(cpu->proc);
+		cpu->proc = get_proc();
+		cpu->time_left = 0;
+	}else if (cpu->time_left == 0) {
+		/* The process has done its job in current time slot */
+		printf("\tCPU %d: Put process %2d to run queue\n",
+			id, cpu->proc->pid);
+		put_proc(cpu->proc);
+		cpu->proc = get_proc();
+	}
 
-		/* Run current process */
-		run(proc);
-		time_left--;
-		next_slot(timer_id);
+	/* Recheck process status after loading new process */
+	if (cpu->proc == NULL && done && nr_blocked_procs() == 0) {
+		/* No process to run, exit */
+		printf("\tCPU %d stopped\n", id);
+		return CPU_STOPPED;
+	}else if (cpu->proc == NULL) {
+		/* There may be new processes to run in
+		 * next time slots, sleep until somebody adds one */
+		return CPU_IDLE;
+	}else if (cpu->time_left == 0) {
+		printf("\tCPU %d: Dispatched process %2d\n",
+			id, cpu->proc->pid);
+		cpu->time_left = time_slot;
 	}
+
+	/* Run current process */
+#ifdef MM_PAGING
+	cpu->proc->tlb = &cpu_tlb[id];
+#endif
+	run(cpu->proc);
+#ifdef MM_PAGING
+	if (device_wait(cpu))
+		return CPU_BUSY;
+#endif
+	cpu->time_left--;
+	return CPU_BUSY;
 #elif CFS_SCHED
-	uint64_t elapsed_ns = 0;
-	uint64_t current_timeslice = 0;
-     while (1) {
-        /* Check the status of current process */
-        if (proc == NULL) {
-            /* No process is running, then we load new process from CFS */
-            proc = cfs_pick_next();
-
-            if (proc == NULL) {
-                next_slot(timer_id);
-                continue; /* No process available, skip this slot */
-            }
-
-            /* Calculate process time slice - include current process weight since it's been dequeued */
-            current_timeslice = cfs_timeslice(proc, proc->cfs_ent.weight) / 1000000; // Convert ns to time slots
-            if (current_timeslice < 1) current_timeslice = 1;
-
-            elapsed_ns = 0;
-            printf("\tCPU %d: Dispatched process %2d (timeslice: %lu)\n",
-                id, proc->pid, current_timeslice);
-        } else if (proc->pc == proc->code->size) {
-            /* The process has finished its job */
-            printf("\tCPU %d: Process %2d has finished\n",
-                id, proc->pid);
-
-            /* We don't need to dequeue as cfs_pick_next already did that */
-            free(proc);
-
-            /* Try to get the next process immediately */
-            proc = cfs_pick_next();
-
-            if (proc != NULL) {
-                /* Calculate process time slice - include current process weight */
-                current_timeslice = cfs_timeslice(proc, proc->cfs_ent.weight) / 1000000; // Convert ns to time slots
-                if (current_timeslice < 1) current_timeslice = 1;
-
-                elapsed_ns = 0;
-                printf("\tCPU %d: Dispatched process %2d (timeslice: %lu)\n",
-                    id, proc->pid, current_timeslice);
-            }
-        } else if (elapsed_ns >= current_timeslice) {
-            /* The process has used its time slice */
-            printf("\tCPU %d: Process %2d used its time slice\n",
-                id, proc->pid);
-
-            /* Update virtual runtime and re-enqueue */
-
-            cfs_task_tick(proc, elapsed_ns * 1000000); // Convert time slots to ns
-
-
-            /* Get the next process immediately */
-            proc = cfs_pick_next();
-
-            if (proc != NULL) {
-                /* Calculate process time slice - include current process weight */
-                current_timeslice = cfs_timeslice(proc, proc->cfs_ent.weight) / 1000000; // Convert ns to time slots
-                if (current_timeslice < 1) current_timeslice = 1;
-
-                elapsed_ns = 0;
-                printf("\tCPU %d: Dispatched process %2d (timeslice: %lu)\n",
-                    id, proc->pid, current_timeslice);
-            }
-        }
-
-        /* Recheck process status after loading new process */
-        if (proc == NULL && done) {
-            /* No process to run, exit */
-            printf("\tCPU %d stopped\n", id);
-            break;
-        } else if (proc == NULL) {
-            /* There may be new processes to run in next time slot */
-            next_slot(timer_id);
-            continue;
-        }
-
-        /* Run current process */
-        run(proc);
-        elapsed_ns++;
-        next_slot(timer_id);
-    }
+	/* Check the status of current process */
+	if (cpu->proc == NULL) {
+		/* No process is running, then we load new process from CFS */
+		cfs_dispatch(cpu);
+	} else if (cpu->proc->pc == cpu->proc->code->size) {
+		/* The process has finished its job */
+		printf("\tCPU %d: Process %2d has finished\n",
+			id, cpu->proc->pid);
+
+		/* We don't need to dequeue as cfs_pick_next already did that */
+		exit_proc(cpu->proc);
+
+		/* Try to get the next process immediately */
+		cfs_dispatch(cpu);
+	} else if (cpu->elapsed_ns >= cpu->current_timeslice) {
+		/* The process has used its time slice */
+		printf("\tCPU %d: Process %2d used its time slice\n",
+			id, cpu->proc->pid);
+
+		/* Update virtual runtime and re-enqueue */
+		cfs_task_tick(id, cpu->proc, cpu->elapsed_ns * 1000000); // Convert time slots to ns
+
+		/* Get the next process immediately */
+		cfs_dispatch(cpu);
+	}
+
+	/* Recheck process status after loading new process */
+	if (cpu->proc == NULL && done && nr_blocked_procs() == 0) {
+		/* No process to run, exit */
+		printf("\tCPU %d stopped\n", id);
+		return CPU_STOPPED;
+	} else if (cpu->proc == NULL) {
+		/* There may be new processes to run later, sleep until
+		 * somebody adds one */
+		return CPU_IDLE;
+	}
+
+	/* Run current process */
+#ifdef MM_PAGING
+	cpu->proc->tlb = &cpu_tlb[id];
 #endif
-	detach_event(timer_id);
+	run(cpu->proc);
+#ifdef MM_PAGING
+	if (device_wait(cpu))
+		return CPU_BUSY;
+#endif
+	cpu->elapsed_ns++;
+	return CPU_BUSY;
+#endif
+}
+
+#ifndef SIM_EVENT_ENGINE
+/* One host thread per simulated CPU */
+static void * cpu_routine(void * args) {
+	struct cpu_args * cpu = (struct cpu_args*)args;
+	enum cpu_state_t state;
+
+	while ((state = cpu_step(cpu)) != CPU_STOPPED) {
+		if (state == CPU_IDLE)
+			idle_slot(cpu->timer_id, next_wake_time());
+		else
+			next_slot(cpu->timer_id);
+	}
+	detach_event(cpu->timer_id);
 	pthread_exit(NULL);
 }
+#else
+/*
+ * worker_routine - drive many simulated CPUs from one host thread.
+ *
+ * The worker keeps its CPUs in two lists keyed by the slot they need
+ * next: busy CPUs run again in the next slot, idle ones are parked
+ * until the scheduler has queued work (or the loader is done, so they
+ * can stop). Per slot the cost is one step per busy CPU plus one per
+ * woken CPU, and a single barrier round-trip for the whole worker.
+ */
+static void * worker_routine(void * args) {
+	struct worker_args * w = (struct worker_args*)args;
+	struct cpu_args ** busy = malloc(w->nr_cpus * sizeof(struct cpu_args*));
+	struct cpu_args ** parked = malloc(w->nr_cpus * sizeof(struct cpu_args*));
+	int nr_busy = 0, nr_parked = 0;
+	int i;
+
+	for (i = 0; i < w->nr_cpus; i++)
+		parked[nr_parked++] = &w->cpus[i];
+
+	while (nr_busy + nr_parked > 0) {
+		int nr_next = 0;
+
+		/* Busy CPUs keep their order, the survivors are compacted */
+		for (i = 0; i < nr_busy; i++) {
+			switch (cpu_step(busy[i])) {
+			case CPU_BUSY:
+				busy[nr_next++] = busy[i];
+				break;
+			case CPU_IDLE:
+				parked[nr_parked++] = busy[i];
+				break;
+			case CPU_STOPPED:
+				break;
+			}
+		}
+		nr_busy = nr_next;
+
+		/* Wake parked CPUs while there is queued work. One that still
+		 * finds nothing means the queues are drained for this slot */
+		wake_procs(current_time());
+		while (nr_parked > 0 && (done || queue_empty() != 0)) {
+			struct cpu_args * cpu = parked[--nr_parked];
+			enum cpu_state_t state = cpu_step(cpu);
+			if (state == CPU_BUSY) {
+				busy[nr_busy++] = cpu;
+			} else if (state == CPU_IDLE) {
+				parked[nr_parked++] = cpu;
+				break;
+			}
+		}
+
+		if (nr_busy + nr_parked == 0)
+			break;
+		if (nr_busy > 0)
+			next_slot(w->timer_id);
+		else
+			idle_slot(w->timer_id, next_wake_time());
+	}
+	free(busy);
+	free(parked);
+	detach_event(w->timer_id);
+	pthread_exit(NULL);
+}
+#endif
 
 static void * ld_routine(void * args) {
 #ifdef MM_PAGING
@@ -199,7 +327,7 @@ static void * ld_routine(void * args) {
 		proc->prio = ld_processes.prio[i];
 #endif
 		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
+			idle_slot(timer_id, ld_processes.start_time[i]);
 		}
 #ifdef MM_PAGING
 		proc->mm = malloc(sizeof(struct mm_struct));
@@ -207,6 +335,10 @@ static void * ld_routine(void * args) {
 		proc->mram = mram;
 		proc->mswp = mswp;
 		proc->active_mswp = active_mswp;
+		proc->tlb = NULL;
+#ifdef MM_KSWAPD
+		mm_register(proc);
+#endif
 #endif
 		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
 			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
@@ -263,7 +395,7 @@ static void read_config(const char * path) {
 #endif
 #endif
 
-#ifdef CFS_SCHED
+#if defined(CFS_SCHED) || defined(MLQ_SCHED)
 	ld_processes.prio = (unsigned long*)
 		malloc(sizeof(unsigned long) * num_processes);
 #endif
@@ -273,7 +405,7 @@ static void read_config(const char * path) {
 		ld_processes.path[i][0] = '\0';
 		strcat(ld_processes.path[i], "input/proc/");
 		char proc[100];
-#ifdef CFS_SCHED
+#if defined(CFS_SCHED) || defined(MLQ_SCHED)
 		fscanf(file, "%lu %s %lu\r\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
 		// printf("This is the process number %d: %s, it has start_time %lu and priority %lu\n", i, proc, ld_processes.start_time[i], ld_processes.prio[i]);
 #else
@@ -285,78 +417,197 @@ static void read_config(const char * path) {
 
 int main(int argc, char * argv[]) {
 	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	if (argc != 2 && argc != 3) {
+		printf("Usage: os [path to configure file] [fifo|clock|2q]\n");
+		return 1;
+	}
+#ifdef MM_PAGING
+	if (argc == 3 && repl_set_policy(argv[2]) != 0) {
+		printf("Unknown page replacement policy: %s\n", argv[2]);
 		return 1;
 	}
+#endif
 	char path[100];
 	path[0] = '\0';
 	strcat(path, "input/");
 	strcat(path, argv[1]);
 	read_config(path);
 
-	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
-		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
+		(struct cpu_args*)calloc(num_cpus, sizeof(struct cpu_args));
 	pthread_t ld;
+#ifdef SIM_EVENT_ENGINE
+	/* M worker threads share the N simulated CPUs */
+	int num_threads = (num_cpus < SIM_NR_WORKERS) ? num_cpus : SIM_NR_WORKERS;
+	struct worker_args * workers =
+		(struct worker_args*)malloc(sizeof(struct worker_args) * num_threads);
+#else
+	int num_threads = num_cpus;
+#endif
+	pthread_t * cpu = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
 
 	/* Init timer */
 	int i;
 	for (i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
 		args[i].id = i;
+		args[i].proc = NULL;
+	}
+#ifdef SIM_EVENT_ENGINE
+	for (i = 0; i < num_threads; i++) {
+		int first = i * num_cpus / num_threads;
+		int last = (i + 1) * num_cpus / num_threads;
+		workers[i].timer_id = attach_event();
+		workers[i].cpus = &args[first];
+		workers[i].nr_cpus = last - first;
 	}
+#else
+	for (i = 0; i < num_cpus; i++)
+		args[i].timer_id = attach_event();
+#endif
 	struct timer_id_t * ld_event = attach_event();
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	pthread_t kswapd;
+	struct kswapd_args kswapd_args;
+	kswapd_args.timer_id = attach_daemon();
+#endif
 	start_timer();
 
 #ifdef MM_PAGING
 	/* Init all MEMPHY include 1 MEMRAM and n of MEMSWP */
 	int rdmflag = 1; /* By default memphy is RANDOM ACCESS MEMORY */
+#ifdef MM_SWAP_SEQ
+	int swprdmflag = 0;
+#else
+	int swprdmflag = rdmflag;
+#endif
 
 	struct memphy_struct mram;
 	struct memphy_struct mswp[PAGING_MAX_MMSWP];
+	struct memphy_struct *mswp_tbl[PAGING_MAX_MMSWP];
+
+	cpu_tlb = malloc(num_cpus * sizeof(struct tlb_struct));
+	for (i = 0; i < num_cpus; i++)
+		tlb_init(&cpu_tlb[i]);
 
 	/* Create MEM RAM */
-	init_memphy(&mram, memramsz, rdmflag);
+	if (init_memphy(&mram, memramsz, rdmflag) != 0) {
+		printf("Cannot allocate %d bytes of RAM\n", memramsz);
+		exit(1);
+	}
+#ifdef MM_ZSWAP
+	zswap_init(&mram);
+#endif
 
         /* Create all MEM SWAP */
 	int sit;
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+#ifdef MM_SWAP_FILE
+	       char swpfile[100];
+
+	       snprintf(swpfile, sizeof(swpfile), MM_SWAP_FILE, sit);
+	       if (memswpsz[sit] > 0 &&
+	           init_memphy_file(&mswp[sit], memswpsz[sit], swprdmflag, swpfile) == 0) {
+	              mswp_tbl[sit] = &mswp[sit];
+	              continue;
+	       }
+	       if (memswpsz[sit] > 0)
+	              printf("Cannot map swap file %s, using memory\n", swpfile);
+#endif
+	       if (init_memphy(&mswp[sit], memswpsz[sit], swprdmflag) != 0) {
+	              printf("Cannot allocate %d bytes of swap %d\n", memswpsz[sit], sit);
+	              exit(1);
+	       }
+	       mswp_tbl[sit] = &mswp[sit];
+	}
+
+	/* Device timing */
+	static const int swplat[PAGING_MAX_MMSWP] = MEMPHY_SWP_LATENCY;
+	static const int swpbw[PAGING_MAX_MMSWP] = MEMPHY_SWP_BANDWIDTH;
+	mram.latency = MEMPHY_RAM_LATENCY;
+	mram.bandwidth = MEMPHY_RAM_BANDWIDTH;
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+		mswp[sit].latency = swplat[sit];
+		mswp[sit].bandwidth = swpbw[sit];
+	}
+	swap_init(mswp_tbl, PAGING_MAX_MMSWP);
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
 
 	mm_ld_args->timer_id = ld_event;
 	mm_ld_args->mram = (struct memphy_struct *) &mram;
-	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
+	mm_ld_args->mswp = mswp_tbl;
 	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
         mm_ld_args->active_mswp_id = 0;
+#ifdef MM_KSWAPD
+	kswapd_args.mram = &mram;
+#endif
 #endif
 
 	/* Init scheduler */
-	init_scheduler();
+	init_scheduler(num_cpus);
 
 	/* Run CPU and loader */
 #ifdef MM_PAGING
 	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
+#ifdef MM_KSWAPD
+	pthread_create(&kswapd, NULL, kswapd_routine, (void*)&kswapd_args);
+#endif
 #else
 	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
 #endif
+#ifdef SIM_EVENT_ENGINE
+	for (i = 0; i < num_threads; i++) {
+		pthread_create(&cpu[i], NULL,
+			worker_routine, (void*)&workers[i]);
+	}
+#else
 	for (i = 0; i < num_cpus; i++) {
 		pthread_create(&cpu[i], NULL,
 			cpu_routine, (void*)&args[i]);
 	}
+#endif
 
 	/* Wait for CPU and loader finishing */
-	for (i = 0; i < num_cpus; i++) {
+	for (i = 0; i < num_threads; i++) {
 		pthread_join(cpu[i], NULL);
 	}
 	pthread_join(ld, NULL);
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	pthread_join(kswapd, NULL);
+#endif
 
 	/* Stop timer */
 	stop_timer();
 
+#if defined(MM_PAGING) && defined(MM_STATS)
+	repl_report();
+	tlb_report(cpu_tlb, num_cpus);
+	swap_report();
+	kmem_cache_report();
+#ifdef MM_ZSWAP
+	zswap_report();
+#endif
+#ifdef MM_KSWAPD
+	kswapd_report();
+#endif
+
+	blocked_report();
+	MEMPHY_report("MEMRAM", &mram);
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+		char swpname[16];
+
+		snprintf(swpname, sizeof(swpname), "MEMSWP%d", sit);
+		MEMPHY_report(swpname, &mswp[sit]);
+	}
+#endif
+
+#ifdef MM_PAGING
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+		free_memphy(&mswp[sit]);
+	free_memphy(&mram);
+#endif
+
 	return 0;
 
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "queue.h"
 
 int empty(struct queue_t *q)
@@ -9,26 +10,98 @@ int empty(struct queue_t *q)
         return (q->size == 0);
 }
 
+/* Make room for at least [need] entries, unwrapping the ring so that the
+ * oldest entry lands at index 0 */
+static void queue_reserve(struct queue_t *q, int need)
+{
+        struct pcb_t **proc;
+        int cap, first;
+
+        if (need <= q->capacity)
+                return;
+        cap = q->capacity ? q->capacity : MAX_QUEUE_SIZE;
+        while (cap < need)
+                cap *= 2;
+
+        proc = malloc(cap * sizeof(struct pcb_t *));
+        first = q->capacity - q->head;
+        if (first > q->size)
+                first = q->size;
+        if (q->size > 0) {
+                memcpy(proc, q->proc + q->head, first * sizeof(struct pcb_t *));
+                memcpy(proc + first, q->proc,
+                       (q->size - first) * sizeof(struct pcb_t *));
+        }
+        free(q->proc);
+        q->proc = proc;
+        q->head = 0;
+        q->capacity = cap;
+}
+
 void enqueue(struct queue_t *q, struct pcb_t *proc)
 {
-        /* TODO: put a new process to queue [q] */
-        q->proc[q->size] = proc;
+        /* put a new process to the tail of queue [q] */
+        queue_reserve(q, q->size + 1);
+        q->proc[(q->head + q->size) % q->capacity] = proc;
         q->size++;
 }
 
 struct pcb_t *dequeue(struct queue_t *q)
 {
-        /* TODO: return a pcb whose prioprity is the highest
-         * in the queue [q] and remember to remove it from q
-         * */
+        /* return the oldest process of queue [q] and remove it from q */
         if (empty(q))
                 return NULL;
-        struct pcb_t *proc = q->proc[0];
-        for (int i = 0; i < q->size - 1; i++)
-        {
-                q->proc[i] = q->proc[i + 1];
-        }
-        q->proc[q->size - 1] = NULL;
+        struct pcb_t *proc = q->proc[q->head];
+        q->proc[q->head] = NULL;
+        q->head = (q->head + 1) % q->capacity;
         q->size--;
         return proc;
-}
\ No newline at end of file
+}
+
+int queue_drain(struct queue_t *dst, struct queue_t *src)
+{
+        int moved, first, tail, chunk;
+
+        if (empty(src))
+                return 0;
+        moved = src->size;
+        queue_reserve(dst, dst->size + moved);
+
+        /* Copy the (at most two) contiguous runs of src into the
+         * (at most two) free runs of dst */
+        while (src->size > 0) {
+                tail = (dst->head + dst->size) % dst->capacity;
+                first = src->capacity - src->head;
+                chunk = src->size < first ? src->size : first;
+                if (chunk > dst->capacity - tail)
+                        chunk = dst->capacity - tail;
+                memcpy(dst->proc + tail, src->proc + src->head,
+                       chunk * sizeof(struct pcb_t *));
+                dst->size += chunk;
+                src->head = (src->head + chunk) % src->capacity;
+                src->size -= chunk;
+        }
+        src->head = 0;
+        return moved;
+}
+
+int queue_remove(struct queue_t *q, struct pcb_t *proc)
+{
+        int i, kept = 0, size;
+
+        if (empty(q))
+                return 0;
+        size = q->size;
+
+        /* Compact the survivors in place, the write index never passes
+         * the read index */
+        for (i = 0; i < size; i++) {
+                struct pcb_t *p = q->proc[(q->head + i) % q->capacity];
+                if (p != proc)
+                        q->proc[(q->head + kept++) % q->capacity] = p;
+        }
+        for (i = kept; i < size; i++)
+                q->proc[(q->head + i) % q->capacity] = NULL;
+        q->size = kept;
+        return size - kept;
+}
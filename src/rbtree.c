@@ -1,24 +1,18 @@
 #include "rbtree.h"
+#include "slab.h"
 #include <stdlib.h>
 #include <stdio.h>
 
-// Create a new node, cloning data if requested
-static RBNode* create_node(RBTree* tree, void* data) {
-    RBNode* node = malloc(sizeof(RBNode));
-    node->data = tree->clone_data ? tree->clone_data(data) : data;
-    node->color = RED;
-    node->left = node->right = node->parent = NULL;
-    return node;
-}
+#define rb_is_black(n) (!(n) || (n)->color == BLACK)
 
 // Left rotate around x
-static void left_rotate(RBTree* tree, RBNode* x) {
-    RBNode* y = x->right;
+static void left_rotate(struct rb_root* root, struct rb_node* x) {
+    struct rb_node* y = x->right;
     x->right = y->left;
     if (y->left) y->left->parent = x;
     y->parent = x->parent;
     if (!x->parent)
-        tree->root = y;
+        root->rb_node = y;
     else if (x == x->parent->left)
         x->parent->left = y;
     else
@@ -28,13 +22,13 @@ static void left_rotate(RBTree* tree, RBNode* x) {
 }
 
 // Right rotate around y
-static void right_rotate(RBTree* tree, RBNode* y) {
-    RBNode* x = y->left;
+static void right_rotate(struct rb_root* root, struct rb_node* y) {
+    struct rb_node* x = y->left;
     y->left = x->right;
     if (x->right) x->right->parent = y;
     x->parent = y->parent;
     if (!y->parent)
-        tree->root = x;
+        root->rb_node = x;
     else if (y == y->parent->left)
         y->parent->left = x;
     else
@@ -44,9 +38,9 @@ static void right_rotate(RBTree* tree, RBNode* y) {
 }
 
 // Replace subtree u with v
-static void transplant(RBTree* tree, RBNode* u, RBNode* v) {
+static void transplant(struct rb_root* root, struct rb_node* u, struct rb_node* v) {
     if (!u->parent)
-        tree->root = v;
+        root->rb_node = v;
     else if (u == u->parent->left)
         u->parent->left = v;
     else
@@ -55,203 +49,299 @@ static void transplant(RBTree* tree, RBNode* u, RBNode* v) {
 }
 
 // Find minimum in subtree
-static RBNode* minimum(RBNode* node) {
+static struct rb_node* minimum(struct rb_node* node) {
     while (node->left)
         node = node->left;
     return node;
 }
 
-// Fix-up after deletion to restore red-black properties
-static void fix_delete(RBTree* tree, RBNode* x) {
-    while (x && x != tree->root && x->color == BLACK) {
-        if (x == x->parent->left) {
-            RBNode* w = x->parent->right;
-            if (w && w->color == RED) {
+// Fix-up after insertion
+void rb_insert_color(struct rb_node* z, struct rb_root* root) {
+    while (z->parent && z->parent->color == RED) {
+        if (z->parent == z->parent->parent->left) {
+            struct rb_node* y = z->parent->parent->right;
+            if (y && y->color == RED) {
+                z->parent->color = BLACK;
+                y->color = BLACK;
+                z->parent->parent->color = RED;
+                z = z->parent->parent;
+            } else {
+                if (z == z->parent->right) {
+                    z = z->parent;
+                    left_rotate(root, z);
+                }
+                z->parent->color = BLACK;
+                z->parent->parent->color = RED;
+                right_rotate(root, z->parent->parent);
+            }
+        } else {
+            struct rb_node* y = z->parent->parent->left;
+            if (y && y->color == RED) {
+                z->parent->color = BLACK;
+                y->color = BLACK;
+                z->parent->parent->color = RED;
+                z = z->parent->parent;
+            } else {
+                if (z == z->parent->left) {
+                    z = z->parent;
+                    right_rotate(root, z);
+                }
+                z->parent->color = BLACK;
+                z->parent->parent->color = RED;
+                left_rotate(root, z->parent->parent);
+            }
+        }
+    }
+    root->rb_node->color = BLACK;
+}
+
+/*
+ * Fix-up after deletion to restore red-black properties. @x may be NULL
+ * (an empty leaf), so its parent is tracked separately in @xp.
+ */
+static void fix_delete(struct rb_root* root, struct rb_node* x, struct rb_node* xp) {
+    while (x != root->rb_node && rb_is_black(x)) {
+        if (x == xp->left) {
+            struct rb_node* w = xp->right;
+            if (w->color == RED) {
                 w->color = BLACK;
-                x->parent->color = RED;
-                left_rotate(tree, x->parent);
-                w = x->parent->right;
+                xp->color = RED;
+                left_rotate(root, xp);
+                w = xp->right;
             }
-            if ((!w->left || w->left->color == BLACK) &&
-                (!w->right || w->right->color == BLACK)) {
+            if (rb_is_black(w->left) && rb_is_black(w->right)) {
                 w->color = RED;
-                x = x->parent;
+                x = xp;
+                xp = x->parent;
             } else {
-                if (!w->right || w->right->color == BLACK) {
-                    if (w->left) w->left->color = BLACK;
+                if (rb_is_black(w->right)) {
+                    w->left->color = BLACK;
                     w->color = RED;
-                    right_rotate(tree, w);
-                    w = x->parent->right;
+                    right_rotate(root, w);
+                    w = xp->right;
                 }
-                w->color = x->parent->color;
-                x->parent->color = BLACK;
+                w->color = xp->color;
+                xp->color = BLACK;
                 if (w->right) w->right->color = BLACK;
-                left_rotate(tree, x->parent);
-                x = tree->root;
+                left_rotate(root, xp);
+                x = root->rb_node;
             }
         } else {
-            RBNode* w = x->parent->left;
-            if (w && w->color == RED) {
+            struct rb_node* w = xp->left;
+            if (w->color == RED) {
                 w->color = BLACK;
-                x->parent->color = RED;
-                right_rotate(tree, x->parent);
-                w = x->parent->left;
+                xp->color = RED;
+                right_rotate(root, xp);
+                w = xp->left;
             }
-            if ((!w->left || w->left->color == BLACK) &&
-                (!w->right || w->right->color == BLACK)) {
+            if (rb_is_black(w->left) && rb_is_black(w->right)) {
                 w->color = RED;
-                x = x->parent;
+                x = xp;
+                xp = x->parent;
             } else {
-                if (!w->left || w->left->color == BLACK) {
-                    if (w->right) w->right->color = BLACK;
+                if (rb_is_black(w->left)) {
+                    w->right->color = BLACK;
                     w->color = RED;
-                    left_rotate(tree, w);
-                    w = x->parent->left;
+                    left_rotate(root, w);
+                    w = xp->left;
                 }
-                w->color = x->parent->color;
-                x->parent->color = BLACK;
+                w->color = xp->color;
+                xp->color = BLACK;
                 if (w->left) w->left->color = BLACK;
-                right_rotate(tree, x->parent);
-                x = tree->root;
+                right_rotate(root, xp);
+                x = root->rb_node;
             }
         }
     }
     if (x) x->color = BLACK;
 }
 
-// Public delete: removes data if found
-void rbtree_delete(RBTree* tree, void* data) {
-    if (!tree) return;
-
-    RBNode* z = tree->root;
-    while (z && tree->cmpop(data, z->data) != 0)
-        z = (tree->cmpop(data, z->data) < 0) ? z->left : z->right;
-    if (!z) return;
-
-    RBNode* y = z;
+// Unlink z from the tree, the node memory belongs to the caller
+void rb_erase(struct rb_node* z, struct rb_root* root) {
+    struct rb_node* y = z;
     Color y_color = y->color;
-    RBNode* x = NULL;
+    struct rb_node* x = NULL;
+    struct rb_node* xp = NULL;
 
     if (!z->left) {
         x = z->right;
-        transplant(tree, z, z->right);
+        xp = z->parent;
+        transplant(root, z, z->right);
     } else if (!z->right) {
         x = z->left;
-        transplant(tree, z, z->left);
+        xp = z->parent;
+        transplant(root, z, z->left);
     } else {
         y = minimum(z->right);
         y_color = y->color;
         x = y->right;
 
         if (y->parent == z) {
-            if (x) x->parent = y;
+            xp = y;
         } else {
-            transplant(tree, y, y->right);
+            xp = y->parent;
+            transplant(root, y, y->right);
             y->right = z->right;
-            if (y->right) y->right->parent = y;
+            y->right->parent = y;
         }
 
-        transplant(tree, z, y);
+        transplant(root, z, y);
         y->left = z->left;
-        if (y->left) y->left->parent = y;
+        y->left->parent = y;
         y->color = z->color;
     }
 
-    if (tree->free_data)
-        tree->free_data(z->data);
-    free(z);
     if (y_color == BLACK)
-        fix_delete(tree, x);
+        fix_delete(root, x, xp);
 }
 
-// Fix-up after insertion
-static void fix_insert(RBTree* tree, RBNode* z) {
-    while (z->parent && z->parent->color == RED) {
-        if (z->parent == z->parent->parent->left) {
-            RBNode* y = z->parent->parent->right;
-            if (y && y->color == RED) {
-                z->parent->color = BLACK;
-                y->color = BLACK;
-                z->parent->parent->color = RED;
-                z = z->parent->parent;
-            } else {
-                if (z == z->parent->right) {
-                    z = z->parent;
-                    left_rotate(tree, z);
-                }
-                z->parent->color = BLACK;
-                z->parent->parent->color = RED;
-                right_rotate(tree, z->parent->parent);
-            }
+void rb_add(struct rb_node* node, struct rb_root* root, RBLess less) {
+    struct rb_node** link = &root->rb_node;
+    struct rb_node* parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        link = less(node, parent) ? &parent->left : &parent->right;
+    }
+    rb_link_node(node, parent, link);
+    rb_insert_color(node, root);
+}
+
+// Insert and keep the leftmost cache: it changes only if we never went right
+void rb_add_cached(struct rb_node* node, struct rb_root_cached* root, RBLess less) {
+    struct rb_node** link = &root->rb_root.rb_node;
+    struct rb_node* parent = NULL;
+    int leftmost = 1;
+
+    while (*link) {
+        parent = *link;
+        if (less(node, parent)) {
+            link = &parent->left;
         } else {
-            RBNode* y = z->parent->parent->left;
-            if (y && y->color == RED) {
-                z->parent->color = BLACK;
-                y->color = BLACK;
-                z->parent->parent->color = RED;
-                z = z->parent->parent;
-            } else {
-                if (z == z->parent->left) {
-                    z = z->parent;
-                    right_rotate(tree, z);
-                }
-                z->parent->color = BLACK;
-                z->parent->parent->color = RED;
-                left_rotate(tree, z->parent->parent);
-            }
+            link = &parent->right;
+            leftmost = 0;
         }
     }
-    tree->root->color = BLACK;
+    if (leftmost)
+        root->rb_leftmost = node;
+    rb_link_node(node, parent, link);
+    rb_insert_color(node, &root->rb_root);
 }
 
-// Public insert
-void rbtree_insert(RBTree* tree, void* data) {
-    RBNode* z = create_node(tree, data);
-    RBNode* y = NULL;
-    RBNode* x = tree->root;
-    while (x) {
-        y = x;
-        x = (tree->cmpop(z->data, x->data) < 0) ? x->left : x->right;
-    }
-    z->parent = y;
-    if (!y)
-        tree->root = z;
-    else if (tree->cmpop(z->data, y->data) < 0)
-        y->left = z;
-    else
-        y->right = z;
-    fix_insert(tree, z);
+void rb_erase_cached(struct rb_node* node, struct rb_root_cached* root) {
+    if (root->rb_leftmost == node)
+        root->rb_leftmost = rb_next(node);
+    rb_erase(node, &root->rb_root);
 }
 
-// In-order traversal
-static void inorder(RBNode* node, PrintFunc print) {
-    if (!node) return;
-    inorder(node->left, print);
-    print(node->data);
-    inorder(node->right, print);
+struct rb_node* rb_first(const struct rb_root* root) {
+    struct rb_node* n = root->rb_node;
+    if (!n) return NULL;
+    while (n->left)
+        n = n->left;
+    return n;
 }
 
-// Public print
-void rbtree_print(RBTree* tree, PrintFunc print) {
-    inorder(tree->root, print);
+struct rb_node* rb_last(const struct rb_root* root) {
+    struct rb_node* n = root->rb_node;
+    if (!n) return NULL;
+    while (n->right)
+        n = n->right;
+    return n;
 }
 
-// Public search: retrieves data if found
-void* rbtree_search(RBTree* tree, void* key) {
-    RBNode* cur = tree->root;
+// In-order successor
+struct rb_node* rb_next(const struct rb_node* node) {
+    struct rb_node* parent;
+    if (node->right)
+        return minimum(node->right);
+    while ((parent = node->parent) && node == parent->right)
+        node = parent;
+    return parent;
+}
+
+// In-order predecessor
+struct rb_node* rb_prev(const struct rb_node* node) {
+    struct rb_node* parent;
+    if (node->left) {
+        node = node->left;
+        while (node->right)
+            node = node->right;
+        return (struct rb_node*)node;
+    }
+    while ((parent = node->parent) && node == parent->left)
+        node = parent;
+    return parent;
+}
+
+/* ===== Generic tree of data pointers ===== */
+
+#define to_rbnode(n) rb_entry(n, RBNode, rb)
+
+static KMEM_CACHE(rbnode_cache, RBNode);
+
+// Create a new node, cloning data if requested
+static RBNode* create_node(RBTree* tree, void* data) {
+    RBNode* node = kmem_cache_alloc(&rbnode_cache);
+    node->data = tree->clone_data ? tree->clone_data(data) : data;
+    return node;
+}
+
+static RBNode* find_node(RBTree* tree, void* key) {
+    struct rb_node* cur = tree->root.rb_node;
     while (cur) {
-        int cmp = tree->cmpop(key, cur->data);
+        int cmp = tree->cmpop(key, to_rbnode(cur)->data);
         if (cmp == 0)
-            return cur->data;
+            return to_rbnode(cur);
         cur = (cmp < 0) ? cur->left : cur->right;
     }
     return NULL;
 }
 
+// Public delete: removes data if found
+void rbtree_delete(RBTree* tree, void* data) {
+    if (!tree) return;
+
+    RBNode* z = find_node(tree, data);
+    if (!z) return;
+
+    rb_erase(&z->rb, &tree->root);
+    if (tree->free_data)
+        tree->free_data(z->data);
+    kmem_cache_free(&rbnode_cache, z);
+}
+
+// Public insert
+void rbtree_insert(RBTree* tree, void* data) {
+    RBNode* z = create_node(tree, data);
+    struct rb_node** link = &tree->root.rb_node;
+    struct rb_node* parent = NULL;
+    while (*link) {
+        parent = *link;
+        link = (tree->cmpop(z->data, to_rbnode(parent)->data) < 0) ?
+               &parent->left : &parent->right;
+    }
+    rb_link_node(&z->rb, parent, link);
+    rb_insert_color(&z->rb, &tree->root);
+}
+
+// Public print: in-order traversal
+void rbtree_print(RBTree* tree, PrintFunc print) {
+    struct rb_node* n;
+    for (n = rb_first(&tree->root); n; n = rb_next(n))
+        print(to_rbnode(n)->data);
+}
+
+// Public search: retrieves data if found
+void* rbtree_search(RBTree* tree, void* key) {
+    RBNode* node = find_node(tree, key);
+    return node ? node->data : NULL;
+}
+
 // Constructor
 RBTree* new_rbtree(CmpOp cmpop, CloneFunc clone_data, FreeFunc free_data) {
     RBTree* tree = malloc(sizeof(RBTree));
-    tree->root = NULL;
+    tree->root = RB_ROOT;
     tree->cmpop = cmpop;
     tree->clone_data = clone_data;
     tree->free_data = free_data;
@@ -259,17 +349,17 @@ RBTree* new_rbtree(CmpOp cmpop, CloneFunc clone_data, FreeFunc free_data) {
 }
 
 // Recursively free nodes
-static void free_node(RBNode* node, FreeFunc free_data) {
+static void free_node(struct rb_node* node, FreeFunc free_data) {
     if (!node) return;
     free_node(node->left, free_data);
     free_node(node->right, free_data);
-    if (free_data) free_data(node->data);
-    free(node);
+    if (free_data) free_data(to_rbnode(node)->data);
+    kmem_cache_free(&rbnode_cache, to_rbnode(node));
 }
 
 // Destructor
 void destroy_rbtree(RBTree* tree) {
     if (!tree) return;
-    free_node(tree->root, tree->free_data);
+    free_node(tree->root.rb_node, tree->free_data);
     free(tree);
-}
\ No newline at end of file
+}
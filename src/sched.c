@@ -1,7 +1,7 @@
 #include "queue.h"
 #include "sched.h"
+#include "bitops.h"
 #include <pthread.h>
-#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -14,42 +14,51 @@ static struct queue_t run_queue;
 static pthread_mutex_t queue_lock;
 
 static struct queue_t running_list;
+/* Processes waiting on a device, a min-heap on their wake-up slot.
+ * blocked_next mirrors the top so the common empty check takes no lock */
+struct blocked_proc {
+    uint64_t wake_at;
+    struct pcb_t *proc;
+};
+static struct blocked_proc *blocked_heap;
+static int nr_blocked;
+static int blocked_cap;
+static pthread_mutex_t blocked_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t blocked_next = TIMER_NEVER;
+static unsigned long nr_block_waits;
+static unsigned long nr_block_slots;
+
 #ifdef MLQ_SCHED
 static struct queue_t mlq_ready_queue[MAX_PRIO];
 static int slot[MAX_PRIO];
-static int curr_prior = 0;
-#endif
-
-#ifdef CFS_SCHED
-static pthread_mutex_t cfs_lock; // protect CFS runqueue
+/* Bit prio is set iff mlq_ready_queue[prio] is not empty, under queue_lock */
+static DECLARE_BITMAP(mlq_bitmap, MAX_PRIO);
 #endif
 
 
 // ===== Generic Helpers =====
 int queue_empty(void) {
 #ifdef CFS_SCHED
-    return (cfs_rq.total_weight == 0) ? 0 : -1;
+    return (cfs_nr_running() == 0) ? 0 : -1;
 #elif defined(MLQ_SCHED)
-    unsigned long prio;
-    for (prio = 0; prio < MAX_PRIO; prio++)
-        if (!empty(&mlq_ready_queue[prio]))
-            return -1;
+    return (find_first_bit(mlq_bitmap, MAX_PRIO) < MAX_PRIO) ? -1 : 0;
 #else
     return (empty(&ready_queue) && empty(&run_queue));
 #endif
 }
 
-void init_scheduler(void) {
+void init_scheduler(int nr_cpus) {
     pthread_mutex_init(&queue_lock, NULL);
 #ifdef CFS_SCHED
-    pthread_mutex_init(&cfs_lock, NULL);
-    cfs_init_rq();
+    /* CFS keeps one runqueue per CPU, each with its own lock */
+    cfs_init_rq(nr_cpus);
 #elif defined(MLQ_SCHED)
     int i;
     for (i = 0; i < MAX_PRIO; i++)
     {
         mlq_ready_queue[i].size = 0;
         slot[i] = MAX_PRIO - i;
+        clear_bit(i, mlq_bitmap);
     }
 #else
     ready_queue.size = 0;
@@ -60,9 +69,7 @@ void init_scheduler(void) {
 
 // ===== Round-Robin Implementation =====
 static void rr_refill(void) {
-    while (!empty(&run_queue)) {
-        enqueue(&ready_queue, dequeue(&run_queue));
-    }
+    queue_drain(&ready_queue, &run_queue);
 }
 
 static struct pcb_t *rr_get(void) {
@@ -82,56 +89,49 @@ static void rr_put(struct pcb_t *proc) {
 
 // ===== MLQ Implementation =====
 #ifdef MLQ_SCHED
-void put_mlq_proc(struct pcb_t *proc)
+/* Queue helpers keeping mlq_bitmap in sync, caller holds queue_lock */
+static void mlq_enqueue(struct pcb_t *proc)
 {
-
     enqueue(&mlq_ready_queue[proc->prio], proc);
-
+    set_bit(proc->prio, mlq_bitmap);
 }
 
-void add_mlq_proc(struct pcb_t *proc)
+static struct pcb_t *mlq_dequeue(unsigned long prio)
 {
+    struct pcb_t *proc = dequeue(&mlq_ready_queue[prio]);
+    if (empty(&mlq_ready_queue[prio]))
+        clear_bit(prio, mlq_bitmap);
+    return proc;
+}
 
-    enqueue(&mlq_ready_queue[proc->prio], proc);
+void put_mlq_proc(struct pcb_t *proc)
+{
+    pthread_mutex_lock(&queue_lock);
+    mlq_enqueue(proc);
+    pthread_mutex_unlock(&queue_lock);
+}
 
+void add_mlq_proc(struct pcb_t *proc)
+{
+    pthread_mutex_lock(&queue_lock);
+    mlq_enqueue(proc);
+    pthread_mutex_unlock(&queue_lock);
 }
 
 struct pcb_t *get_mlq_proc(void)
 {
-    /*TODO: get a process from PRIORITY [ready_queue].
-     * Remember to use lock to protect the queue.
+    /* The highest non-empty priority is the first set bit of mlq_bitmap,
+     * so dispatch cost does not depend on MAX_PRIO.
      * */
     pthread_mutex_lock(&queue_lock);
     struct pcb_t *proc = NULL;
-    unsigned long prio;
-    bool isEmpty = false;
-    curr_prior = 0;
-    for (prio = curr_prior; prio < MAX_PRIO; prio++)
+    unsigned long prio = find_first_bit(mlq_bitmap, MAX_PRIO);
+    if (prio < MAX_PRIO)
     {
-        curr_prior = prio;
-        if (!empty(&mlq_ready_queue[prio]))
-        {
-            slot[prio] -= 1;
-            proc = dequeue(&mlq_ready_queue[prio]);
-            if (slot[prio] == 0 || empty(&mlq_ready_queue[prio]))
-            {
-                slot[prio] = MAX_PRIO - prio;
-                curr_prior++;
-                if (curr_prior >= MAX_PRIO)
-                {
-                    curr_prior = 0;
-                }
-            }
-            break;
-        }
-        if (curr_prior >= MAX_PRIO)
-        {
-            curr_prior = 0;
-            if (isEmpty)
-                break;
-            isEmpty = true;
-            prio = -1;
-        }
+        slot[prio] -= 1;
+        proc = mlq_dequeue(prio);
+        if (slot[prio] == 0 || empty(&mlq_ready_queue[prio]))
+            slot[prio] = MAX_PRIO - prio;
     }
     pthread_mutex_unlock(&queue_lock);
     return proc;
@@ -143,10 +143,7 @@ struct pcb_t *get_proc(void) {
     struct pcb_t *proc = NULL;
 
 #ifdef CFS_SCHED
-    pthread_mutex_lock(&queue_lock);
-    pthread_mutex_lock(&cfs_lock);
-    proc = cfs_pick_next();
-    pthread_mutex_unlock(&cfs_lock);
+    return cfs_pick_any();
 #elif defined(MLQ_SCHED)
     /*TODO: get a process from [ready_queue].
      * Remember to use lock to protect the queue.
@@ -162,11 +159,8 @@ struct pcb_t *get_proc(void) {
 void add_proc(struct pcb_t *proc) {
 
 #ifdef CFS_SCHED
-    proc->cfs_ent.vruntime = 0;
     proc->cfs_ent.weight   = cfs_compute_weight(proc->cfs_ent.weight);
-    pthread_mutex_lock(&cfs_lock);
-    cfs_enqueue(proc);
-    pthread_mutex_unlock(&cfs_lock);
+    cfs_add_task(proc);
 #elif defined(MLQ_SCHED)
     proc->ready_queue = &ready_queue;
     proc->mlq_ready_queue = mlq_ready_queue;
@@ -191,9 +185,7 @@ void add_proc(struct pcb_t *proc) {
 void put_proc(struct pcb_t *proc) {
 
 #ifdef CFS_SCHED
-    pthread_mutex_lock(&cfs_lock);
-    cfs_enqueue(proc);
-    pthread_mutex_unlock(&cfs_lock);
+    cfs_requeue_task(proc);
 #elif defined(MLQ_SCHED)
     proc->ready_queue = &ready_queue;
     proc->mlq_ready_queue = mlq_ready_queue;
@@ -211,3 +203,108 @@ void put_proc(struct pcb_t *proc) {
     rr_put(proc);
 #endif
 }
+
+/* add_proc() also links every MLQ process into ready_queue and the
+ * running lists, which killall walks */
+void remove_proc(struct pcb_t *proc) {
+    pthread_mutex_lock(&queue_lock);
+    queue_remove(&ready_queue, proc);
+    queue_remove(&run_queue, proc);
+    queue_remove(&running_list, proc);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+// ===== Blocked processes =====
+/* Caller holds blocked_lock */
+static void blocked_swap(int i, int j) {
+    struct blocked_proc tmp = blocked_heap[i];
+    blocked_heap[i] = blocked_heap[j];
+    blocked_heap[j] = tmp;
+}
+
+/*
+ * block_proc - take a process off the CPU until slot @wake_at
+ * @proc:    process waiting on a device, not on any runqueue
+ * @wake_at: first slot it may run again
+ */
+void block_proc(struct pcb_t *proc, uint64_t wake_at) {
+    int i;
+
+    pthread_mutex_lock(&blocked_lock);
+    if (nr_blocked == blocked_cap) {
+        int newcap = blocked_cap ? 2 * blocked_cap : 16;
+        blocked_heap = realloc(blocked_heap, newcap * sizeof(*blocked_heap));
+        blocked_cap = newcap;
+    }
+    i = nr_blocked++;
+    blocked_heap[i].wake_at = wake_at;
+    blocked_heap[i].proc = proc;
+    while (i > 0 && blocked_heap[(i - 1) / 2].wake_at > blocked_heap[i].wake_at) {
+        blocked_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    __atomic_store_n(&blocked_next, blocked_heap[0].wake_at, __ATOMIC_RELEASE);
+    nr_block_waits++;
+    nr_block_slots += wake_at - current_time() - 1;
+    pthread_mutex_unlock(&blocked_lock);
+}
+
+/* Pop the earliest process if it is due at @now. Caller holds blocked_lock */
+static struct pcb_t *blocked_pop(uint64_t now) {
+    struct pcb_t *proc;
+    int i = 0;
+
+    if (nr_blocked == 0 || blocked_heap[0].wake_at > now)
+        return NULL;
+    proc = blocked_heap[0].proc;
+    blocked_heap[0] = blocked_heap[--nr_blocked];
+    for (;;) {
+        int min = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < nr_blocked && blocked_heap[l].wake_at < blocked_heap[min].wake_at)
+            min = l;
+        if (r < nr_blocked && blocked_heap[r].wake_at < blocked_heap[min].wake_at)
+            min = r;
+        if (min == i)
+            break;
+        blocked_swap(i, min);
+        i = min;
+    }
+    __atomic_store_n(&blocked_next, nr_blocked ? blocked_heap[0].wake_at : TIMER_NEVER,
+                     __ATOMIC_RELEASE);
+    return proc;
+}
+
+/* Put every process whose wait is over at slot @now back on a runqueue.
+ * Under CFS put_proc() picks the least loaded one and renormalises the
+ * vruntime against it */
+void wake_procs(uint64_t now) {
+    struct pcb_t *proc;
+
+    while (__atomic_load_n(&blocked_next, __ATOMIC_ACQUIRE) <= now) {
+        pthread_mutex_lock(&blocked_lock);
+        proc = blocked_pop(now);
+        pthread_mutex_unlock(&blocked_lock);
+        if (proc == NULL)
+            break;
+        put_proc(proc);
+    }
+}
+
+/* Slot of the earliest wake-up, TIMER_NEVER if nobody is blocked */
+uint64_t next_wake_time(void) {
+    return __atomic_load_n(&blocked_next, __ATOMIC_ACQUIRE);
+}
+
+int nr_blocked_procs(void) {
+    int nr;
+
+    pthread_mutex_lock(&blocked_lock);
+    nr = nr_blocked;
+    pthread_mutex_unlock(&blocked_lock);
+    return nr;
+}
+
+void blocked_report(void) {
+    printf("Device waits: %lu, %lu slots blocked\n",
+           nr_block_waits, nr_block_slots);
+}
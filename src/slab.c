@@ -0,0 +1,138 @@
+#include "slab.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SLAB_ALIGN(sz) \
+	(((sz) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+struct magazine {
+	int nr;
+	void *obj[SLAB_MAG_SIZE];
+};
+
+/* Slot 0 is never used, a cache that found no free slot goes straight
+ * to its depot */
+static __thread struct magazine slab_mag[SLAB_MAX_CACHES + 1];
+
+static pthread_mutex_t slab_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct kmem_cache *slab_caches;
+static int slab_nr_caches;
+
+/* Magazine slot of @cache, registering it on first use */
+static int slab_cache_id(struct kmem_cache *cache) {
+	int id = __atomic_load_n(&cache->id, __ATOMIC_ACQUIRE);
+
+	if (id != 0)
+		return id;
+
+	pthread_mutex_lock(&slab_caches_lock);
+	if (cache->id == 0 && slab_nr_caches < SLAB_MAX_CACHES) {
+		cache->next = slab_caches;
+		slab_caches = cache;
+		__atomic_store_n(&cache->id, ++slab_nr_caches, __ATOMIC_RELEASE);
+	}
+	id = cache->id;
+	pthread_mutex_unlock(&slab_caches_lock);
+	return id;
+}
+
+/* Carve a new block into free objects. Caller holds cache->lock */
+static int slab_grow(struct kmem_cache *cache) {
+	size_t objsize = SLAB_ALIGN(cache->objsize);
+	int nr = (SLAB_BYTES - sizeof(void *)) / objsize;
+	char *slab;
+	int i;
+
+	if (nr < 1)
+		nr = 1;
+	slab = malloc(sizeof(void *) + nr * objsize);
+	if (slab == NULL)
+		return -1;
+
+	*(void **)slab = cache->slabs;
+	cache->slabs = slab;
+	for (i = nr - 1; i >= 0; i--) {
+		void *obj = slab + sizeof(void *) + i * objsize;
+		*(void **)obj = cache->freelist;
+		cache->freelist = obj;
+	}
+	cache->nr_slabs++;
+	cache->nr_objs += nr;
+	return 0;
+}
+
+/* Fill @mag up to @nr objects from the depot */
+static void slab_refill(struct kmem_cache *cache, struct magazine *mag, int nr) {
+	pthread_mutex_lock(&cache->lock);
+	while (mag->nr < nr) {
+		void *obj;
+
+		if (cache->freelist == NULL && slab_grow(cache) != 0)
+			break;
+		obj = cache->freelist;
+		cache->freelist = *(void **)obj;
+		mag->obj[mag->nr++] = obj;
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* Give objects of @mag back to the depot until @nr are left */
+static void slab_flush(struct kmem_cache *cache, struct magazine *mag, int nr) {
+	pthread_mutex_lock(&cache->lock);
+	while (mag->nr > nr) {
+		void *obj = mag->obj[--mag->nr];
+		*(void **)obj = cache->freelist;
+		cache->freelist = obj;
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache) {
+	int id = slab_cache_id(cache);
+	struct magazine local = { 0 };
+	struct magazine *mag = id ? &slab_mag[id] : &local;
+
+	if (mag->nr == 0)
+		slab_refill(cache, mag, id ? SLAB_MAG_SIZE / 2 : 1);
+	if (mag->nr == 0)
+		return NULL;
+
+	__atomic_add_fetch(&cache->nr_active, 1, __ATOMIC_RELAXED);
+	return mag->obj[--mag->nr];
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj) {
+	int id;
+	struct magazine *mag;
+
+	if (obj == NULL)
+		return;
+
+	id = slab_cache_id(cache);
+	__atomic_sub_fetch(&cache->nr_active, 1, __ATOMIC_RELAXED);
+	if (id == 0) {
+		struct magazine local = { .nr = 1, .obj = { obj } };
+		slab_flush(cache, &local, 0);
+		return;
+	}
+
+	mag = &slab_mag[id];
+	if (mag->nr == SLAB_MAG_SIZE)
+		slab_flush(cache, mag, SLAB_MAG_SIZE / 2);
+	mag->obj[mag->nr++] = obj;
+}
+
+/* Occupancy of every cache used so far */
+void kmem_cache_report(void) {
+	struct kmem_cache *cache;
+
+	pthread_mutex_lock(&slab_caches_lock);
+	for (cache = slab_caches; cache != NULL; cache = cache->next) {
+		pthread_mutex_lock(&cache->lock);
+		printf("slab %-22s: %lu/%lu objects in use, %lu slabs\n",
+			cache->name, (unsigned long)cache->nr_active,
+			cache->nr_objs, cache->nr_slabs);
+		pthread_mutex_unlock(&cache->lock);
+	}
+	pthread_mutex_unlock(&slab_caches_lock);
+}
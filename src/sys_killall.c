@@ -15,78 +15,85 @@
 #include "queue.h"
 #include "stdlib.h"
 #include "string.h"
+#include "mm.h"
+
+/* Terminate every process of [q] named [proc_name], keeping the order of
+ * the others. Each entry is popped once and survivors are pushed back */
+static void killall_queue(struct queue_t *q, const char *proc_name)
+{
+    int n = q->size;
+    while (n-- > 0) {
+        struct pcb_t *proc = dequeue(q);
+        char temp_name[100];
+        BYTE* storage = proc->mram->storage;
+        int j = 0;
+        while (storage[j] != -1 && storage[j] != '\0') {
+            temp_name[j] = storage[j];
+            j++;
+        }
+        temp_name[j] = '\0';
+        if (strcmp(temp_name, proc_name) == 0) {
+            proc->pc = proc->code->size;
+            free_pcb_memph(proc);
+        } else {
+            enqueue(q, proc);
+        }
+    }
+}
+
+/* Read the NUL or -1 terminated name at the start of region [memrg], one
+ * ranged read per page instead of one syscall per byte */
+static int killall_read_name(struct pcb_t *caller, uint32_t memrg,
+                             char *name, int size)
+{
+    struct vm_rg_struct *rg;
+    int len = 0;
+
+    if (memrg >= PAGING_MAX_SYMTBL_SZ)
+        return -1;
+    rg = &caller->mm->symrgtbl[memrg];
+
+    while (len < size - 1) {
+        int cur = rg->rg_start + len;
+        int chunk = PAGING_PAGESZ - PAGING_OFFST(cur);
+        int i;
+
+        if (chunk > size - 1 - len)
+            chunk = size - 1 - len;
+        if (chunk > rg->rg_end - rg->rg_start - len)
+            chunk = rg->rg_end - rg->rg_start - len;
+        if (chunk <= 0 ||
+            libread_range(caller, memrg, len, (BYTE *)name + len, chunk) != 0)
+            break;
+
+        for (i = len; i < len + chunk; i++) {
+            if (name[i] == -1 || name[i] == '\0') {
+                name[i] = '\0';
+                return 0;
+            }
+        }
+        len += chunk;
+    }
+    name[len] = '\0';
+    return 0;
+}
 
 int __sys_killall(struct pcb_t *caller, struct sc_regs* regs)
 {
     char proc_name[100];
-    uint32_t data;
 
     //hardcode for demo only
     uint32_t memrg = regs->a3;
     /* Get name of the target proc */
-    int i = 0;
-    data = 0;
-    while(data != -1){
-        libread(caller, memrg, i, &data);
-        proc_name[i] = data;
-        if(data == -1) proc_name[i] = '\0';
-        i++;
-    }
+    if (killall_read_name(caller, memrg, proc_name, sizeof(proc_name)) != 0)
+        return -1;
     printf("The procname retrieved from memregionid %d is \"%s\"\n", memrg, proc_name);
 
     // running_list
-    if (caller->running_list != NULL) {
-        struct queue_t *q = caller->running_list;
-        int write_idx = 0;
-        for (int read_idx = 0; read_idx < q->size; read_idx++) {
-            char temp_name[100];
-            BYTE* storage = q->proc[read_idx]->mram->storage;
-            int j = 0;
-            while (storage[j] != -1 && storage[j] != '\0') {
-                temp_name[j] = storage[j];
-                j++;
-            }
-            temp_name[j] = '\0';
-            if (q->proc[read_idx] != NULL && strcmp(temp_name, proc_name) == 0) {
-                q->proc[read_idx]->pc = q->proc[read_idx]->code->size;
-                free_pcb_memph(q->proc[read_idx]);
-                q->proc[read_idx] = NULL;
-            } else {
-                if (read_idx != write_idx) {
-                    q->proc[write_idx] = q->proc[read_idx];
-                    q->proc[read_idx] = NULL;
-                }
-                write_idx++;
-            }
-        }
-        q->size = write_idx;
-    }
+    if (caller->running_list != NULL)
+        killall_queue(caller->running_list, proc_name);
 
-    if (caller->ready_queue != NULL) {
-        struct queue_t *q = caller->ready_queue;
-        int write_idx = 0;
-        for (int read_idx = 0; read_idx < q->size; read_idx++) {
-            char temp_name[100];
-            BYTE* storage = q->proc[read_idx]->mram->storage;
-            int j = 0;
-            while (storage[j] != -1 && storage[j] != '\0') {
-                temp_name[j] = storage[j];
-                j++;
-            }
-            temp_name[j] = '\0';
-            if (q->proc[read_idx] != NULL && strcmp(temp_name, proc_name) == 0) {
-                q->proc[read_idx]->pc = q->proc[read_idx]->code->size;
-                free_pcb_memph(q->proc[read_idx]);
-                q->proc[read_idx] = NULL;
-            } else {
-                if (read_idx != write_idx) {
-                    q->proc[write_idx] = q->proc[read_idx];
-                    q->proc[read_idx] = NULL;
-                }
-                write_idx++;
-            }
-        }
-        q->size = write_idx;
-    }
+    if (caller->ready_queue != NULL)
+        killall_queue(caller->ready_queue, proc_name);
     return 0; 
 }
\ No newline at end of file
@@ -17,6 +17,7 @@
  {
      int memop = regs->a1;
      BYTE value;
+     int swpent;
      int ret = 0;
  
      switch (memop) {
@@ -29,7 +30,10 @@
              fprintf(stderr, "SYSMEM_INC_OP failed\n");
          break;
      case SYSMEM_SWP_OP:
-         ret = __mm_swap_page(caller, regs->a2, regs->a3);
+         /* a3 carries the swap entry in and the one written out back */
+         swpent = regs->a3;
+         ret = __mm_swap_page(caller, regs->a2, &swpent);
+         regs->a3 = swpent;
          if (ret != 0)
              fprintf(stderr, "SYSMEM_SWP_OP failed\n");
          break;
@@ -42,6 +46,19 @@
      case SYSMEM_IO_WRITE:
          ret = MEMPHY_write(caller->mram, regs->a2, regs->a3);
          break;
+     case SYSMEM_IO_READ_RANGE:
+         ret = MEMPHY_read_range(caller->mram, regs->a2, regs->buf, regs->a4);
+         break;
+     case SYSMEM_IO_WRITE_RANGE:
+         ret = MEMPHY_write_range(caller->mram, regs->a2, regs->buf, regs->a4);
+         break;
+     case SYSMEM_IO_FILL:
+         ret = MEMPHY_fill(caller->mram, regs->a2, regs->a3, regs->a4);
+         break;
+     case SYSMEM_IO_COPY:
+         ret = MEMPHY_copy_range(caller->mram, regs->a2,
+                                 caller->mram, regs->a3, regs->a4);
+         break;
      default:
          printf("Unknown Memop code: %d\n", memop);
      }
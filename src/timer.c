@@ -3,7 +3,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-static pthread_t _timer;
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
 
 struct timer_id_container_t {
 	struct timer_id_t id;
@@ -15,65 +19,88 @@ static struct timer_id_container_t * dev_list = NULL;
 static uint64_t _time;
 
 static int timer_started = 0;
-static int timer_stop = 0;
-
-
-static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		if (current_time() < 100) printf("Time slot %3lu\n", current_time());
-		int fsh = 0;
-		int event = 0;
-		/* Wait for all devices have done the job in current
-		 * time slot */
-		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
-			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
-		}
 
-		/* Increase the time slot */
+/*
+ * Slot barrier shared by every attached device. A device arriving in
+ * next_slot bumps nr_arrived; the last one to arrive advances the clock
+ * and bumps epoch, which releases everybody waiting on the old value.
+ * Waiters only compare epoch against the value they saw on arrival, so
+ * the barrier is immediately reusable for the next slot.
+ *
+ * Each arrival also states the earliest slot it needs to run again. If
+ * nobody needs the next slot (every device is idle or waiting for a
+ * later event), the clock jumps straight to the earliest such slot.
+ */
+static pthread_mutex_t barrier_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t barrier_cond = PTHREAD_COND_INITIALIZER;
+static int nr_devices;	/* attached and not yet detached */
+static int nr_daemons;	/* of which background devices */
+static int nr_arrived;	/* done with the current slot */
+static int stopped;	/* only daemons are left */
+static uint64_t epoch;
+static uint64_t next_event = TIMER_NEVER;
+
+/* Move to the next slot that has work, or skip ahead to the next pending
+ * event, and release the waiters. Caller holds barrier_lock */
+static void advance_slot(void) {
+	uint64_t target = _time + 1;
+
+	/* TIMER_NEVER from everyone: nothing is scheduled, just tick */
+	if (next_event != TIMER_NEVER && next_event > target)
+		target = next_event;
+	next_event = TIMER_NEVER;
+	nr_arrived = 0;
+
+	/* Skipped slots keep their header so the trace stays slot-accurate */
+	while (_time < target) {
 		_time++;
-		
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
-			pthread_mutex_unlock(&temp->id.timer_lock);
-		}
-		if (fsh == event) {
-			break;
-		}
+		if (_time < 100) printf("Time slot %3lu\n", _time);
 	}
-	pthread_exit(args);
+	__atomic_store_n(&epoch, epoch + 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&barrier_cond);
 }
 
 void next_slot(struct timer_id_t * timer_id) {
+	idle_slot(timer_id, _time + 1);
+}
+
+void idle_slot(struct timer_id_t * timer_id, uint64_t wake_at) {
+	uint64_t my_epoch;
+	int spin;
+
 	/* Tell to timer that we have done our job in current slot */
-	pthread_mutex_lock(&timer_id->event_lock);
-	timer_id->done = 1;
-	pthread_cond_signal(&timer_id->event_cond);
-	pthread_mutex_unlock(&timer_id->event_lock);
-
-	/* Wait for going to next slot */
-	pthread_mutex_lock(&timer_id->timer_lock);
-	while (timer_id->done) {
-		pthread_cond_wait(
-			&timer_id->timer_cond,
-			&timer_id->timer_lock
-		);
+	pthread_mutex_lock(&barrier_lock);
+	if (stopped) {
+		pthread_mutex_unlock(&barrier_lock);
+		return;
+	}
+	my_epoch = epoch;
+	if (wake_at <= _time)
+		wake_at = _time + 1;
+	if (wake_at < next_event)
+		next_event = wake_at;
+	if (++nr_arrived == nr_devices) {
+		advance_slot();
+		pthread_mutex_unlock(&barrier_lock);
+		return;
+	}
+	pthread_mutex_unlock(&barrier_lock);
+
+	/* Wait for going to next slot, spinning first if configured */
+	for (spin = 0; spin < TIMER_SPIN_COUNT; spin++) {
+		if (__atomic_load_n(&epoch, __ATOMIC_ACQUIRE) != my_epoch)
+			return;
+		cpu_relax();
 	}
-	pthread_mutex_unlock(&timer_id->timer_lock);
+
+	pthread_mutex_lock(&barrier_lock);
+	while (epoch == my_epoch && !stopped)
+		pthread_cond_wait(&barrier_cond, &barrier_lock);
+	pthread_mutex_unlock(&barrier_lock);
+}
+
+int timer_stopped() {
+	return __atomic_load_n(&stopped, __ATOMIC_ACQUIRE);
 }
 
 uint64_t current_time() {
@@ -82,14 +109,26 @@ uint64_t current_time() {
 
 void start_timer() {
 	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+	printf("Time slot %3lu\n", current_time());
 }
 
 void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
+	pthread_mutex_lock(&barrier_lock);
 	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
+	nr_devices--;
+	if (event->daemon) {
+		nr_daemons--;
+	} else if (nr_devices == nr_daemons) {
+		/* Nothing left to simulate, release the daemons for good */
+		__atomic_store_n(&stopped, 1, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&barrier_cond);
+		pthread_mutex_unlock(&barrier_lock);
+		return;
+	}
+	/* The others may all be waiting on this device alone */
+	if (nr_devices > 0 && nr_arrived == nr_devices)
+		advance_slot();
+	pthread_mutex_unlock(&barrier_lock);
 }
 
 struct timer_id_t * attach_event() {
@@ -100,12 +139,8 @@ struct timer_id_t * attach_event() {
 			(struct timer_id_container_t*)malloc(
 				sizeof(struct timer_id_container_t)		
 			);
-		container->id.done = 0;
 		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
+		container->id.daemon = 0;
 		if (dev_list == NULL) {
 			dev_list = container;
 			dev_list->next = NULL;
@@ -113,20 +148,25 @@ struct timer_id_t * attach_event() {
 			container->next = dev_list;
 			dev_list = container;
 		}
+		nr_devices++;
 		return &(container->id);
 	}
 }
 
+struct timer_id_t * attach_daemon() {
+	struct timer_id_t * id = attach_event();
+	if (id != NULL) {
+		id->daemon = 1;
+		nr_daemons++;
+	}
+	return id;
+}
+
 void stop_timer() {
-	timer_stop = 1;
-	pthread_join(_timer, NULL);
+	timer_started = 0;
 	while (dev_list != NULL) {
 		struct timer_id_container_t * temp = dev_list;
 		dev_list = dev_list->next;
-		pthread_cond_destroy(&temp->id.event_cond);
-		pthread_mutex_destroy(&temp->id.event_lock);
-		pthread_cond_destroy(&temp->id.timer_cond);
-		pthread_mutex_destroy(&temp->id.timer_lock);
 		free(temp);
 	}
 }